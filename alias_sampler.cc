@@ -0,0 +1,250 @@
+#include <assert.h>
+
+#include "alias_sampler.h"
+#include "model_context.h"
+#include "utils.h"
+
+namespace atm {
+
+// =======================================================================
+// AliasTable
+// =======================================================================
+
+AliasTable::AliasTable()
+		: draws_(0) {
+}
+
+void AliasTable::build(const vector<double>& weights, vector<int>* stacks) {
+	int size = weights.size();
+	assert(size > 0);
+	weights_ = weights;
+	prob_.resize(size);
+	alias_.resize(size);
+	draws_ = 0;
+
+	// Every index is in at most one of the small and the large stacks,
+	// so both fit in size values: the small stack grows from the front
+	// of stacks and the large one from the back.
+	stacks->resize(size);
+	int* small = stacks->data();
+	int* large = small + size;
+	int small_no = 0;
+	int large_no = 0;
+
+	double sum = Utils::Sum(weights);
+	for (int i = 0; i < size; i++) {
+		prob_[i] = weights[i] * size / sum;
+		alias_[i] = i;
+		if (prob_[i] < 1.0) {
+			small[small_no++] = i;
+		} else {
+			large[-++large_no] = i;
+		}
+	}
+
+	while (small_no > 0 && large_no > 0) {
+		int s = small[--small_no];
+		int l = large[-large_no];
+		alias_[s] = l;
+		prob_[l] += prob_[s] - 1.0;
+		if (prob_[l] < 1.0) {
+			large_no--;
+			small[small_no++] = l;
+		}
+	}
+
+	// Whatever is left is 1 up to rounding.
+	for (int i = 0; i < small_no; i++) prob_[small[i]] = 1.0;
+	for (int i = 1; i <= large_no; i++) prob_[large[-i]] = 1.0;
+}
+
+int AliasTable::sample(double rand_no) const {
+	int size = prob_.size();
+	double x = rand_no * size;
+	int i = x;
+	if (i >= size) i = size - 1;
+	return (x - i < prob_[i]) ? i : alias_[i];
+}
+
+// =======================================================================
+// AliasSampler
+// =======================================================================
+
+AliasSampler::AliasSampler()
+		: alpha_(0.0),
+		  mh_steps_(1),
+		  unassigned_(0),
+		  proposals_(0),
+		  accepted_(0) {
+}
+
+double AliasSampler::getAcceptanceRate() const {
+	if (proposals_ == 0) return 0.0;
+	return static_cast<double>(accepted_) / proposals_;
+}
+
+AliasTable* AliasSampler::getWordTable(int word_id, AllTopics* all_topics) {
+	int topics = all_topics->getTopics();
+	int word_no = all_topics->getMutableTopic(0)->getCorpusWordNo();
+	if (word_tables_.size() < static_cast<size_t>(word_no)) {
+		word_tables_.resize(word_no);
+	}
+
+	AliasTable* table = &word_tables_[word_id];
+	if (table->empty() || table->getDraws() >= topics) {
+		Topic* topic = all_topics->getMutableTopic(0);
+		double eta = topic->getEta();
+		double eta_sum = eta * topic->getCorpusWordNo();
+		weights_.assign(topics, eta);
+		all_topics->addWordCounts(word_id, weights_.data());
+		const TokenIndex* topic_word_nos = all_topics->getTopicWordNos();
+		for (int i = 0; i < topics; i++) {
+			weights_[i] /= topic_word_nos[i] + eta_sum;
+		}
+		table->build(weights_, &stacks_);
+	}
+	return table;
+}
+
+double AliasSampler::targetPr(Author* author,
+															int word_id,
+															int topic_id,
+															AllTopics* all_topics) const {
+	Topic* topic = all_topics->getMutableTopic(topic_id);
+	double eta = topic->getEta();
+	return (author->getTopicCounts(topic_id) + alpha_) *
+				 (topic->getWordCount(word_id) + eta) /
+				 (topic->getTopicWordNo() + eta * topic->getCorpusWordNo());
+}
+
+int AliasSampler::sampleAuthorTopic(Author* author,
+																		int word_pos,
+																		int topics,
+																		ModelContext* context) const {
+	Random* random = context->getMutableRandom();
+	int others = author->getWords() - 1;
+	double rand_no = random->uniform() * (others + topics * alpha_);
+	if (rand_no < others) {
+		int j = rand_no;
+		if (j >= word_pos) j++;
+		Word word = context->getMutableAllWords()->getMutableWord(
+				author->getWord(j));
+		if (word.getTopicId() != -1) {
+			return word.getTopicId();
+		}
+	}
+
+	int topic_id = random->uniform() * topics;
+	return (topic_id < topics) ? topic_id : topics - 1;
+}
+
+double AliasSampler::authorProposalPr(Author* author,
+																			int topic_id,
+																			int topics) const {
+	return author->getTopicCounts(topic_id) + alpha_ +
+				 static_cast<double>(unassigned_) / topics;
+}
+
+void AliasSampler::sampleTopic(Author* author,
+															 int word_pos,
+															 bool remove,
+															 ModelContext* context,
+															 bool inf) {
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Random* random = context->getMutableRandom();
+	Word word = context->getMutableAllWords()->getMutableWord(
+			author->getWord(word_pos));
+	int word_id = word.getId();
+	int topics = all_topics->getTopics();
+
+	// The current word gets a topic below, so it no longer
+	// counts as an unassigned word of the author.
+	int topic_id = word.getTopicId();
+	if (topic_id == -1) {
+		unassigned_--;
+	}
+	if (remove) {
+		AuthorUtils::UpdateTopicFromWord(author, word, -1, all_topics, inf);
+	} else {
+		topic_id = -1;
+	}
+
+	AliasTable* table = getWordTable(word_id, all_topics);
+
+	// Without a current topic, start the chain from the word proposal.
+	if (topic_id == -1) {
+		topic_id = table->sample(random->uniform());
+		table->incDraws();
+	}
+
+	double topic_pr = targetPr(author, word_id, topic_id, all_topics);
+	for (int step = 0; step < mh_steps_; step++) {
+		// Word proposal.
+		int new_topic_id = table->sample(random->uniform());
+		table->incDraws();
+		proposals_++;
+		if (new_topic_id == topic_id) {
+			accepted_++;
+		} else {
+			double new_topic_pr = targetPr(author, word_id, new_topic_id, all_topics);
+			double accept = new_topic_pr * table->getWeight(topic_id) /
+											(topic_pr * table->getWeight(new_topic_id));
+			if (random->uniform() < accept) {
+				topic_id = new_topic_id;
+				topic_pr = new_topic_pr;
+				accepted_++;
+			}
+		}
+
+		// Author proposal.
+		new_topic_id = sampleAuthorTopic(author, word_pos, topics, context);
+		proposals_++;
+		if (new_topic_id == topic_id) {
+			accepted_++;
+		} else {
+			double new_topic_pr = targetPr(author, word_id, new_topic_id, all_topics);
+			double accept = new_topic_pr *
+											authorProposalPr(author, topic_id, topics) /
+											(topic_pr * authorProposalPr(author, new_topic_id, topics));
+			if (random->uniform() < accept) {
+				topic_id = new_topic_id;
+				topic_pr = new_topic_pr;
+				accepted_++;
+			}
+		}
+	}
+
+	word.setTopicId(topic_id);
+	AuthorUtils::UpdateTopicFromWord(author, word, 1, all_topics, inf);
+}
+
+void AliasSampler::sampleTopics(Author* author,
+																int permute_words,
+																bool remove,
+																double alpha,
+																ModelContext* context,
+																bool inf) {
+	int author_word_count = author->getWords();
+	if (author_word_count == 0) return;
+
+	// Permute the words in the author.
+	if (permute_words == 1) {
+		AuthorUtils::PermuteWords(author, context);
+	}
+
+	alpha_ = alpha;
+	AllWords* all_words = context->getMutableAllWords();
+	unassigned_ = 0;
+	for (int i = 0; i < author_word_count; i++) {
+		Word word = all_words->getMutableWord(author->getWord(i));
+		if (word.getTopicId() == -1) {
+			unassigned_++;
+		}
+	}
+
+	for (int i = 0; i < author_word_count; i++) {
+		sampleTopic(author, i, remove, context, inf);
+	}
+}
+
+}  // namespace atm
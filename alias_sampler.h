@@ -0,0 +1,120 @@
+#ifndef ALIAS_SAMPLER_H_
+#define ALIAS_SAMPLER_H_
+
+#include <vector>
+
+#include "author.h"
+#include "topic.h"
+
+using namespace std;
+
+namespace atm {
+
+// Walker's alias table over a discrete distribution given by
+// unnormalized weights, built with Vose's method.
+// Building costs O(size), a draw costs O(1).
+class AliasTable {
+public:
+	AliasTable();
+
+	// stacks is scratch space for the construction, reused across
+	// builds.
+	void build(const vector<double>& weights, vector<int>* stacks);
+	bool empty() const { return prob_.empty(); }
+
+	// Draw an index, rand_no is uniform in [0, 1).
+	int sample(double rand_no) const;
+
+	// The weight the table was built with.
+	double getWeight(int i) const { return weights_[i]; }
+
+	// Number of draws since the table was built.
+	int getDraws() const { return draws_; }
+	void incDraws() { ++draws_; }
+
+private:
+	vector<double> prob_;
+	vector<int> alias_;
+	vector<double> weights_;
+	int draws_;
+};
+
+// Metropolis-Hastings topic sampler in the style of LightLDA
+// (Yuan et al., 2015) and AliasLDA (Li et al., 2014).
+// Each word alternates two kinds of MH steps targeting
+//   pi(k) = (n_ak + alpha) (n_kw + eta) / (n_k + V eta):
+// a word proposal drawn from a per-word alias table over
+//   (n_kw + eta) / (n_k + V eta),
+// built lazily and rebuilt once it has served TOPIC_NO draws, and an
+// author proposal over n_ak + alpha, drawn in O(1) by picking the topic
+// of a random other word of the author.
+// Stale tables only change the proposal, the acceptance ratio
+// uses the weights the table was built with, so the chain stays exact.
+class AliasSampler {
+public:
+	AliasSampler();
+
+	// Sample the word topics for a given author,
+	// with the same arguments as AuthorUtils::SampleTopics.
+	void sampleTopics(Author* author,
+										int permute_words,
+										bool remove,
+										double alpha,
+										ModelContext* context,
+										bool inf=false);
+
+	// Number of (word, author) proposal pairs per word.
+	void setMHSteps(int mh_steps) { mh_steps_ = mh_steps; }
+	int getMHSteps() const { return mh_steps_; }
+
+	// Drop the word alias tables, after the topics are renumbered.
+	void clearTables() { word_tables_.clear(); }
+
+	// Fraction of proposals accepted since the last reset.
+	double getAcceptanceRate() const;
+	void resetAcceptanceRate() { proposals_ = 0; accepted_ = 0; }
+
+private:
+	void sampleTopic(Author* author,
+									 int word_pos,
+									 bool remove,
+									 ModelContext* context,
+									 bool inf);
+
+	// The word alias table, rebuilt if it is stale.
+	AliasTable* getWordTable(int word_id, AllTopics* all_topics);
+
+	// Unnormalized target probability of the topic for the word.
+	double targetPr(Author* author, int word_id, int topic_id,
+									AllTopics* all_topics) const;
+
+	// Draw a topic proportional to n_ak + alpha (without the word
+	// at word_pos), unassigned words of the author propose uniformly.
+	int sampleAuthorTopic(Author* author, int word_pos, int topics,
+												ModelContext* context) const;
+
+	// Author proposal weight of the topic, matching sampleAuthorTopic.
+	double authorProposalPr(Author* author, int topic_id, int topics) const;
+
+	double alpha_;
+	int mh_steps_;
+
+	// Words of the current author, other than the sampled one,
+	// without a topic.
+	int unassigned_;
+
+	// Alias tables per word id.
+	vector<AliasTable> word_tables_;
+
+	// Scratch space for building alias tables.
+	vector<double> weights_;
+	vector<int> stacks_;
+
+	// Acceptance statistics.
+	long proposals_;
+	long accepted_;
+};
+
+}  // namespace atm
+
+#endif  // ALIAS_SAMPLER_H_
@@ -0,0 +1,67 @@
+#include "alloc_counter.h"
+
+#ifdef ATM_ALLOC_COUNT
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+namespace {
+
+std::atomic<long> ALLOCATIONS(0);
+
+void* CountedAlloc(size_t size) {
+  ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return CountedAlloc(size); }
+
+void* operator new[](size_t size) { return CountedAlloc(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+  return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+  return malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete[](void* p) noexcept { free(p); }
+
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+#endif
+
+namespace atm {
+
+// =======================================================================
+// AllocCounter
+// =======================================================================
+
+bool AllocCounter::IsEnabled() {
+#ifdef ATM_ALLOC_COUNT
+  return true;
+#else
+  return false;
+#endif
+}
+
+long AllocCounter::GetAllocations() {
+#ifdef ATM_ALLOC_COUNT
+  return ALLOCATIONS.load(std::memory_order_relaxed);
+#else
+  return 0;
+#endif
+}
+
+}  // namespace atm
@@ -0,0 +1,21 @@
+#ifndef ALLOC_COUNTER_H_
+#define ALLOC_COUNTER_H_
+
+namespace atm {
+
+// Count of the heap allocations of the program, to check that the
+// sampling loops do not allocate per word. Counting replaces the global
+// operator new and is only built with make ALLOC_COUNT=1, which defines
+// ATM_ALLOC_COUNT; otherwise nothing is counted and GetAllocations
+// returns 0. Allocations inside gsl (malloc) are not counted.
+class AllocCounter {
+ public:
+  static bool IsEnabled();
+
+  // Number of calls to operator new and new[] since the program started.
+  static long GetAllocations();
+};
+
+}  // namespace atm
+
+#endif  // ALLOC_COUNTER_H_
@@ -8,10 +8,9 @@
 
 #include "utils.h"
 #include "author.h"
+#include "model_context.h"
 #include "topic.h"
 
-const int BUF_SIZE = 1000;
-
 namespace atm {
 
 // =======================================================================
@@ -21,30 +20,171 @@ namespace atm {
 Author::Author() {	
 }
 
+// An author gets dense topic counts above 1/4 of the topics nonzero,
+// and sparse ones below 1/8.
+const int AUTHOR_PROMOTE = 4;
+const int AUTHOR_DEMOTE = 8;
+
 Author::Author(int id, int topic_no) 
 		: id_(id),
-		  topic_no_(topic_no),
-		  topic_counts_(topic_no, 0) {
+		  topic_no_(topic_no) {
+
+}
+
+void Author::setWords(vector<TokenIndex>&& words, AllWords* all_words) {
+	words_ = move(words);
+	indexWords(all_words);
+}
+
+void Author::indexWords(AllWords* all_words) {
+	int size = words_.size();
+	for (int i = 0; i < size; i++) {
+		all_words->getMutableWord(words_[i]).setAuthorPos(i);
+	}
+}
+
+void Author::setWord(int i, const TokenIndex& word, AllWords* all_words) {
+	words_.at(i) = word;
+	all_words->getMutableWord(word).setAuthorPos(i);
+}
+
+void Author::addWord(TokenIndex word, AllWords* all_words) {
+	all_words->getMutableWord(word).setAuthorPos(words_.size());
+	words_.push_back(word);
+}
+
+void Author::removeWord(TokenIndex word, AllWords* all_words) {
+	Word removed = all_words->getMutableWord(word);
+	int pos = removed.getAuthorPos();
+	if (pos < 0 || pos >= static_cast<int>(words_.size()) ||
+			words_[pos] != word) {
+		return;
+	}
+
+	TokenIndex last = words_.back();
+	words_[pos] = last;
+	all_words->getMutableWord(last).setAuthorPos(pos);
+	words_.pop_back();
+	removed.setAuthorPos(-1);
+}
 
+int Author::getTopicCounts(int topic_id) const {
+	assert(topic_id >= 0 && topic_id < topic_no_);
+	if (isDense()) return topic_counts_[topic_id];
+	auto found = lower_bound(nonzero_topics_.begin(), nonzero_topics_.end(),
+													 topic_id);
+	if (found == nonzero_topics_.end() || *found != topic_id) return 0;
+	return nonzero_counts_[found - nonzero_topics_.begin()];
 }
 
-void Author::removeWord(int word) {
-	auto found = find(begin(words_), end(words_), word);
-	if (found == end(words_)) {
+void Author::setTopicCounts(int topic_id, int count) {
+	assert(topic_id >= 0 && topic_id < topic_no_);
+	auto found = lower_bound(nonzero_topics_.begin(), nonzero_topics_.end(),
+													 topic_id);
+	int pos = found - nonzero_topics_.begin();
+	bool nonzero = found != nonzero_topics_.end() && *found == topic_id;
+
+	if (isDense()) {
+		topic_counts_[topic_id] = count;
+		if (!nonzero && count != 0) {
+			nonzero_topics_.insert(found, topic_id);
+		} else if (nonzero && count == 0) {
+			nonzero_topics_.erase(found);
+			if (static_cast<int>(nonzero_topics_.size()) * AUTHOR_DEMOTE <
+					topic_no_) {
+				setDense(false);
+			}
+		}
+		return;
+	}
+
+	if (nonzero && count != 0) {
+		nonzero_counts_[pos] = count;
+	} else if (nonzero) {
+		nonzero_topics_.erase(found);
+		nonzero_counts_.erase(nonzero_counts_.begin() + pos);
+	} else if (count != 0) {
+		nonzero_topics_.insert(found, topic_id);
+		nonzero_counts_.insert(nonzero_counts_.begin() + pos, count);
+		if (static_cast<int>(nonzero_topics_.size()) * AUTHOR_PROMOTE >
+				topic_no_) {
+			setDense(true);
+		}
+	}
+}
+
+void Author::updateTopicCounts(int topic_id, int value) {
+	if (isDense()) {
+		int count = topic_counts_[topic_id] + value;
+		if (count != 0 && count != value) {
+			// The topic stays nonzero.
+			topic_counts_[topic_id] = count;
+			return;
+		}
+	}
+	setTopicCounts(topic_id, getTopicCounts(topic_id) + value);
+}
+
+void Author::addTopicCounts(double* values) const {
+	int nonzero_topic_no = nonzero_topics_.size();
+	for (int i = 0; i < nonzero_topic_no; i++) {
+		values[nonzero_topics_[i]] += getNonzeroCount(i);
+	}
+}
 
+void Author::setDense(bool dense) {
+	int nonzero_topic_no = nonzero_topics_.size();
+	if (dense) {
+		topic_counts_.assign(topic_no_, 0);
+		for (int i = 0; i < nonzero_topic_no; i++) {
+			topic_counts_[nonzero_topics_[i]] = nonzero_counts_[i];
+		}
+		vector<int>().swap(nonzero_counts_);
 	} else {
-		words_.erase(found);
+		nonzero_counts_.resize(nonzero_topic_no);
+		for (int i = 0; i < nonzero_topic_no; i++) {
+			nonzero_counts_[i] = topic_counts_[nonzero_topics_[i]];
+		}
+		vector<int>().swap(topic_counts_);
+	}
+}
+
+void Author::compactTopics(const vector<int>& topic_map, int topic_no) {
+	// The kept topics are renumbered in order, so the nonzero topics stay
+	// sorted.
+	vector<int> nonzero_topics;
+	vector<int> nonzero_counts;
+	int nonzero_topic_no = nonzero_topics_.size();
+	for (int i = 0; i < nonzero_topic_no; i++) {
+		int topic_id = topic_map[nonzero_topics_[i]];
+		if (topic_id != -1) {
+			nonzero_topics.push_back(topic_id);
+			nonzero_counts.push_back(getNonzeroCount(i));
+		}
+	}
+	nonzero_topics_ = move(nonzero_topics);
+	nonzero_counts_ = move(nonzero_counts);
+	vector<int>().swap(topic_counts_);
+	topic_no_ = topic_no;
+	if (static_cast<int>(nonzero_topics_.size()) * AUTHOR_PROMOTE > topic_no_) {
+		setDense(true);
 	}
 }
 
 int Author::getSumTopicCounts(int topic_no) const {
 	int sum = 0;
-	for (int i = 0; i < topic_no; i++) {
-		sum += topic_counts_[i];
+	int nonzero_topic_no = nonzero_topics_.size();
+	for (int i = 0; i < nonzero_topic_no && nonzero_topics_[i] < topic_no; i++) {
+		sum += getNonzeroCount(i);
 	}
 	return sum;
 }
 
+size_t Author::getBytes() const {
+	return (topic_counts_.capacity() + nonzero_topics_.capacity() +
+					nonzero_counts_.capacity()) * sizeof(int);
+}
+
 
 
 
@@ -52,9 +192,20 @@ int Author::getSumTopicCounts(int topic_no) const {
 // AllAuthors
 // =======================================================================
 
-AllAuthors& AllAuthors::GetInstance() {
-	static AllAuthors instance;
-	return instance;
+int AllAuthors::getDenseAuthors() const {
+	int dense = 0;
+	for (const Author& author : authors_) {
+		if (author.isDense()) dense++;
+	}
+	return dense;
+}
+
+size_t AllAuthors::getBytes() const {
+	size_t bytes = 0;
+	for (const Author& author : authors_) {
+		bytes += author.getBytes();
+	}
+	return bytes;
 }
 
 
@@ -63,72 +214,80 @@ AllAuthors& AllAuthors::GetInstance() {
 // AuthorUtils
 // =======================================================================
 
-void AuthorUtils::PermuteWords(Author* author) {
-  int size = author->getWords();
+void AuthorUtils::PermuteWords(Author* author, ModelContext* context) {
+	int size = author->getWords();
 	if (size == 0) return;
-  vector<int> permuted_words;
 
-  // Permute the values in perm.
-  // These values correspond to the indices of the words in the
-  // word vector of the author.
-  gsl_permutation* perm = gsl_permutation_calloc(size);
-  Utils::Shuffle(perm, size);
-  int perm_size = perm->size;
-  assert(size == perm_size);
+	context->getMutableRandom()->shuffle(author->getMutableWords(), size);
+	author->indexWords(context->getMutableAllWords());
+}
 
-  for (int i = 0; i < perm_size; i++) {
-    permuted_words.push_back(author->getWord(perm->data[i]));
-  }
+void AuthorUtils::SortWords(Author* author, ModelContext* context) {
+	AllWords* all_words = context->getMutableAllWords();
+	int size = author->getWords();
+	TokenIndex* words = author->getMutableWords();
+	vector<pair<int, TokenIndex>>& sort_keys = *context->getMutableSortKeys();
+	sort_keys.clear();
+	for (int i = 0; i < size; i++) {
+		sort_keys.emplace_back(all_words->getMutableWord(words[i]).getId(),
+													 words[i]);
+	}
 
-  author->setWords(move(permuted_words));
+	sort(sort_keys.begin(), sort_keys.end());
 
-  gsl_permutation_free(perm);
+	for (int i = 0; i < size; i++) {
+		words[i] = sort_keys[i].second;
+	}
+	author->indexWords(all_words);
 }
 
 
 void AuthorUtils::UpdateTopicFromWord(Author* author,
-																			 Word* word,
+																			 Word word,
 																			 int update,
 																			 AllTopics* all_topics,
 																			 bool inf) {
-	int topic_id = word->getTopicId();
+	int topic_id = word.getTopicId();
 	if (topic_id == -1) {
 		return;
 	}
 
 	author->updateTopicCounts(topic_id, update);
 	if (not inf) {
-		Topic* topic = all_topics->getMutableTopic(topic_id);
-		topic->updateWordCount(word->getId(), update);
+		all_topics->updateWordCount(topic_id, word.getId(), update);
 	}
 
 }
 
 void AuthorUtils::SampleTopic(
 			Author* author,
-			int word_idx,
+			TokenIndex word_idx,
       bool remove,
       double alpha,
-      AllTopics* all_topics,
+      ModelContext* context,
       bool inf) {
 
-	AllWords& all_words = AllWords::GetInstance();
-	Word* word = all_words.getMutableWord(word_idx);
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Word word = context->getMutableAllWords()->getMutableWord(word_idx);
 	if (remove) {
 		UpdateTopicFromWord(author, word, -1, all_topics, inf);
 	}
 
 	int topics = all_topics->getTopics();
-	vector<double> log_pr(topics, 0.0);
+	vector<double>& log_pr = *context->getMutableLogPr();
+	vector<double>& author_pr = *context->getMutableTopicPr();
+	log_pr.resize(topics);
+	AllTopicsUtils::WordProbabilities(all_topics, word.getId(), log_pr.data());
+	author_pr.assign(topics, alpha);
+	author->addTopicCounts(author_pr.data());
 	for (int i = 0; i < topics; i++) {
-		Topic* topic = all_topics->getMutableTopic(i);
-		int topic_count = author->getTopicCounts(i);
-		log_pr[i] = log(topic_count + alpha) + topic->getLogPrWord(word->getId());
+		log_pr[i] += log(author_pr[i]);
 	}
 
-	int sample_topic_id = Utils::SampleFromLogPr(log_pr);
+	int sample_topic_id = Utils::SampleFromLogPr(
+			log_pr, context->getMutableRandom()->uniform());
 
-	word->setTopicId(sample_topic_id);
+	word.setTopicId(sample_topic_id);
 	UpdateTopicFromWord(author, word, 1, all_topics, inf);
 }
 
@@ -137,7 +296,7 @@ void AuthorUtils::SampleTopics(
       int permute_words,
       bool remove,
       double alpha,
-      AllTopics* all_topics,
+      ModelContext* context,
       bool inf) {
 
 	int author_word_count = author->getWords();
@@ -146,27 +305,42 @@ void AuthorUtils::SampleTopics(
 
 	// Permute the words in the author.
 	if (permute_words == 1) {
-		PermuteWords(author);
+		PermuteWords(author, context);
 	}
 	
 	for (int i = 0; i < author_word_count; i++) {
-		int word_idx = author->getWord(i);
-		SampleTopic(author, word_idx, remove, alpha, all_topics, inf);
+		TokenIndex word_idx = author->getWord(i);
+		SampleTopic(author, word_idx, remove, alpha, context, inf);
 	}
 }
 
-double AuthorUtils::AlphaScore(Author* author, double alpha) {
+double AuthorUtils::AlphaScore(Author* author,
+															 double alpha,
+															 const vector<double>* topic_alphas) {
 	double score = 0.0;
-	double lgam_alpha = gsl_sf_lngamma(alpha);
-	int word_count = author->getWords();
 	int topic_no = author->getTopicNo();
+	// Count occurrences rather than words, words may be grouped.
+	int word_count = author->getSumTopicCounts(topic_no);
 
-	score += gsl_sf_lngamma(topic_no * alpha);
-	for (int i = 0; i < topic_no; i++) {
-		int topic_count = author->getTopicCounts(i);
-		if (topic_count > 0) {
-			score += gsl_sf_lngamma(topic_count + alpha) - lgam_alpha;
+	if (topic_alphas != nullptr) {
+		double sum_alpha = 0.0;
+		for (int i = 0; i < topic_no; i++) {
+			sum_alpha += (*topic_alphas)[i];
 		}
+		for (int i = 0; i < author->getNonzeroTopics(); i++) {
+			double topic_alpha = (*topic_alphas)[author->getNonzeroTopic(i)];
+			score += gsl_sf_lngamma(author->getNonzeroCount(i) + topic_alpha) -
+					gsl_sf_lngamma(topic_alpha);
+		}
+		score += gsl_sf_lngamma(sum_alpha) -
+				gsl_sf_lngamma(word_count + sum_alpha);
+		return score;
+	}
+
+	double lgam_alpha = gsl_sf_lngamma(alpha);
+	score += gsl_sf_lngamma(topic_no * alpha);
+	for (int i = 0; i < author->getNonzeroTopics(); i++) {
+		score += gsl_sf_lngamma(author->getNonzeroCount(i) + alpha) - lgam_alpha;
 	}
 
 	score -= gsl_sf_lngamma(word_count + topic_no * alpha);
@@ -174,26 +348,103 @@ double AuthorUtils::AlphaScore(Author* author, double alpha) {
 	return score;
 }
 
-vector<double> AuthorUtils::TopicProportion(Author* author, 
-																						double alpha) {
+template <int TOPIC_NO>
+void AuthorUtils::TopicProportionSized(Author* author,
+																			 double alpha,
+																			 const double* topic_alphas,
+																			 int topic_no,
+																			 double* log_pr) {
+	if (TOPIC_NO > 0) topic_no = TOPIC_NO;
 
-	int topic_no = author->getTopicNo();
-	vector<double> log_pr(topic_no, 0.0);
 	int sum_topic_count = author->getSumTopicCounts(topic_no);
+	int nonzero_topic_no = author->getNonzeroTopics();
+
+	// The zero topics get the log of their alpha, the nonzero topics are
+	// then overwritten.
+	if (topic_alphas != nullptr) {
+		double sum_alpha = 0.0;
+		for (int i = 0; i < topic_no; i++) {
+			sum_alpha += topic_alphas[i];
+		}
+		double log_norm = log(sum_topic_count + sum_alpha);
+		for (int i = 0; i < topic_no; i++) {
+			log_pr[i] = log(topic_alphas[i]) - log_norm;
+		}
+		for (int i = 0; i < nonzero_topic_no; i++) {
+			int topic_id = author->getNonzeroTopic(i);
+			log_pr[topic_id] = log(author->getNonzeroCount(i) +
+														 topic_alphas[topic_id]) - log_norm;
+		}
+		return;
+	}
 
+	double log_norm = log(sum_topic_count + topic_no * alpha);
+	double log_alpha = log(alpha) - log_norm;
 	for (int i = 0; i < topic_no; i++) {
-		log_pr[i] = log(author->getTopicCounts(i) + alpha) - 
-								log(sum_topic_count + topic_no * alpha);
+		log_pr[i] = log_alpha;
 	}
+	for (int i = 0; i < nonzero_topic_no; i++) {
+		log_pr[author->getNonzeroTopic(i)] =
+				log(author->getNonzeroCount(i) + alpha) - log_norm;
+	}
+}
 
+vector<double> AuthorUtils::TopicProportion(
+		Author* author,
+		double alpha,
+		const vector<double>* topic_alphas) {
+	vector<double> log_pr(author->getTopicNo(), 0.0);
+	TopicProportion(author, alpha, topic_alphas, log_pr.data());
 	return log_pr;
 }
 
+void AuthorUtils::TopicProportion(Author* author,
+																	double alpha,
+																	const vector<double>* topic_alphas,
+																	double* log_pr) {
+	int topic_no = author->getTopicNo();
+	const double* alphas = (topic_alphas != nullptr) ? topic_alphas->data()
+																									 : nullptr;
+
+	switch (topic_no) {
+		case 16:
+			TopicProportionSized<16>(author, alpha, alphas, topic_no, log_pr);
+			break;
+		case 32:
+			TopicProportionSized<32>(author, alpha, alphas, topic_no, log_pr);
+			break;
+		case 50:
+			TopicProportionSized<50>(author, alpha, alphas, topic_no, log_pr);
+			break;
+		case 64:
+			TopicProportionSized<64>(author, alpha, alphas, topic_no, log_pr);
+			break;
+		case 100:
+			TopicProportionSized<100>(author, alpha, alphas, topic_no, log_pr);
+			break;
+		case 128:
+			TopicProportionSized<128>(author, alpha, alphas, topic_no, log_pr);
+			break;
+		default:
+			TopicProportionSized<0>(author, alpha, alphas, topic_no, log_pr);
+			break;
+	}
+}
+
 void AuthorUtils::SaveAuthor(Author* author, ofstream& ofs) {
+	// The counts are saved dense, one per topic, filling the zeros
+	// between the nonzero topics.
 	int topic_no = author->getTopicNo();
-	for (int i = 0; i < topic_no; i++) {
-		int topic_count = author->getTopicCounts(i);
-		ofs << topic_count << " ";
+	int next_topic = 0;
+	for (int i = 0; i < author->getNonzeroTopics(); i++) {
+		for (; next_topic < author->getNonzeroTopic(i); next_topic++) {
+			ofs << "0 ";
+		}
+		ofs << author->getNonzeroCount(i) << " ";
+		next_topic++;
+	}
+	for (; next_topic < topic_no; next_topic++) {
+		ofs << "0 ";
 	}
 	ofs << endl;
 }
@@ -202,45 +453,50 @@ void AuthorUtils::SaveAuthor(Author* author, ofstream& ofs) {
 // AllAuthorsUtils
 // =======================================================================
 
-double AllAuthorsUtils::AlphaScores(double alpha) {
+double AllAuthorsUtils::AlphaScores(AllAuthors* all_authors,
+																		double alpha,
+																		const vector<double>* topic_alphas) {
 	double score = 0.0;
-	AllAuthors& all_authors = AllAuthors::GetInstance();
-	int authors = all_authors.getAuthors();
+	int authors = all_authors->getAuthors();
 	for (int i = 0; i < authors; i++) {
-		Author* author = all_authors.getMutableAuthor(i);
-		score += AuthorUtils::AlphaScore(author, alpha);
+		Author* author = all_authors->getMutableAuthor(i);
+		score += AuthorUtils::AlphaScore(author, alpha, topic_alphas);
 	}	
 	return score;
 }
 
-void AllAuthorsUtils::SaveAuthors(const string& filename_authors) {
-	AllAuthors& all_authors = AllAuthors::GetInstance();
-	int author_no = all_authors.getAuthors();
+void AllAuthorsUtils::SaveAuthors(AllAuthors* all_authors,
+																	const string& filename_authors) {
+	int author_no = all_authors->getAuthors();
 	ofstream ofs(filename_authors);
 
 	for (int i = 0; i < author_no; i++) {
-		Author* author = all_authors.getMutableAuthor(i);
+		Author* author = all_authors->getMutableAuthor(i);
 		AuthorUtils::SaveAuthor(author, ofs);
 	}
 	ofs.close();
 }
 
-void AllAuthorsUtils::LoadAuthors(const string& filename_authors) {
+void AllAuthorsUtils::LoadAuthors(AllAuthors* all_authors,
+																	const string& filename_authors) {
 	ifstream ifs(filename_authors);
-	AllAuthors& all_authors = AllAuthors::GetInstance();
-	int topic_no = all_authors.getMutableAuthor(0)->getTopicNo();
-	int authors = all_authors.getAuthors();
+	int topic_no = all_authors->getMutableAuthor(0)->getTopicNo();
+	int authors = all_authors->getAuthors();
 
-	char buf[BUF_SIZE];
+	// A line has topic_no counts, read it whole whatever its length.
+	string line;
 	for (int i = 0; i < authors; i++) {
-		ifs.getline(buf, BUF_SIZE);
-		istringstream iss(buf);
+		getline(ifs, line);
+		istringstream iss(line);
 
-		Author* author = all_authors.getMutableAuthor(i);
+		Author* author = all_authors->getMutableAuthor(i);
 		for (int j = 0; j < topic_no; j++) {
 			string str;
 			getline(iss, str, ' ');
-			author->setTopicCounts(j, atoi(str.c_str()));
+			int count = atoi(str.c_str());
+			if (count != 0) {
+				author->setTopicCounts(j, count);
+			}
 		}	
 	}
 	ifs.close();	
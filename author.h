@@ -16,6 +16,7 @@ namespace atm {
 class Topic;
 class Tree;
 class AllTopics;
+class ModelContext;
 
 // An author has an id, a author score, a topic path
 // from the root of the tree to the leaf and
@@ -30,26 +31,55 @@ public:
 
 	int getId() const { return id_; }
 
-	int getTopicCounts(int topic_id) const { return topic_counts_.at(topic_id); }
-	void setTopicCounts(int topic_id, int count) { topic_counts_[topic_id] = count; }
+	// The topic counts are sparse while few topics are nonzero: the
+	// nonzero topics and their counts are kept in two parallel vectors and
+	// a count is found by binary search. Above 1/4 of the topics nonzero
+	// the author switches to a dense vector of topic_no counts, and back
+	// below 1/8.
+	int getTopicCounts(int topic_id) const;
+	void setTopicCounts(int topic_id, int count);
 	int getSumTopicCounts(int topic_no) const;
-	void updateTopicCounts(int topic_id, int value) {
-		topic_counts_.at(topic_id) += value;
+	void updateTopicCounts(int topic_id, int value);
+	// Add the count of each nonzero topic k to values[k].
+	void addTopicCounts(double* values) const;
+
+	// Topics with a nonzero count in this author, in increasing order,
+	// and their counts.
+	int getNonzeroTopics() const { return nonzero_topics_.size(); }
+	int getNonzeroTopic(int i) const { return nonzero_topics_[i]; }
+	int getNonzeroCount(int i) const {
+		return isDense() ? topic_counts_[nonzero_topics_[i]] : nonzero_counts_[i];
 	}
 
+	bool isDense() const { return !topic_counts_.empty(); }
+	// Memory of the topic counts in bytes.
+	size_t getBytes() const;
+
 	int getTopicNo() const { return topic_no_; }
 	void setTopicNo(int topic_no) { topic_no_ = topic_no; }
 
+	// Drop the counts of the topics mapped to -1 and renumber the others,
+	// topic_map[k] is the new id of topic k, topic_no the new number.
+	void compactTopics(const vector<int>& topic_map, int topic_no);
+
 	double getScore() const { return score_; }
 	void setScore(double score) { score_ = score; }
 
 	int getWords() const { return words_.size(); }
-	void setWords(vector<int>&& words) { words_ = move(words); }
-
-	int getWord(int i) { return words_.at(i); }
-	void setWord(int i, const int& word) { words_.at(i) = word; }
-	void addWord(int word) { words_.push_back(word); }
-	void removeWord(int word);
+	void setWords(vector<TokenIndex>&& words, AllWords* all_words);
+	// The words can be reordered in place, followed by indexWords to
+	// store their new positions.
+	TokenIndex* getMutableWords() { return words_.data(); }
+	void indexWords(AllWords* all_words);
+
+	// Each word stores its position in words_ (Word::getAuthorPos) in
+	// all_words, the words of the model of the author, so that a word is
+	// removed in O(1) by moving the last word into its place. Removing
+	// changes the order of the words.
+	TokenIndex getWord(int i) { return words_.at(i); }
+	void setWord(int i, const TokenIndex& word, AllWords* all_words);
+	void addWord(TokenIndex word, AllWords* all_words);
+	void removeWord(TokenIndex word, AllWords* all_words);
 
 private:
 	// Author id;
@@ -58,13 +88,23 @@ private:
 	// Topic number.
 	int topic_no_;
 
-	vector<int> words_;
+	vector<TokenIndex> words_;
 	// Word counts.
 	// std::vector<int> word_counts_;
 
-	// Topic counts.
+	// Switch between the sparse and the dense topic counts.
+	void setDense(bool dense);
+
+	// Topic counts of a dense author, empty for a sparse author.
 	vector<int> topic_counts_;
 
+	// Topic ids whose count is nonzero, in increasing order, kept up to
+	// date by setTopicCounts and updateTopicCounts.
+	vector<int> nonzero_topics_;
+	// Counts of nonzero_topics_ of a sparse author, empty for a dense
+	// author.
+	vector<int> nonzero_counts_;
+
 	// Author score.
 	double score_;
 };
@@ -86,30 +126,57 @@ public:
       int permute_words,
       bool remove,
       double eta,
-      AllTopics* all_topics,
+      ModelContext* context,
       bool inf=false);
 
 	static void SampleTopic(
 			Author* author,
-			int word_idx,
+			TokenIndex word_idx,
 			bool remove,
 			double alpha,
-			AllTopics* all_topics,
+			ModelContext* context,
 			bool inf=false);
 
 	static void UpdateTopicFromWord(Author* author, 
-																	 Word* word,
+																	 Word word,
 																	 int update,
 																	 AllTopics* all_topics,
 																	 bool inf=false);
 
-	static void PermuteWords(Author* author);
+	static void PermuteWords(Author* author, ModelContext* context);
+
+	// Sort the words in the author by word id, so that a sweep reads
+	// the topic word counts of each word id once and in order.
+	static void SortWords(Author* author, ModelContext* context);
 
-	static double AlphaScore(Author* author, double alpha);
+	// topic_alphas, if given, replaces alpha with one alpha per topic.
+	static double AlphaScore(Author* author,
+													 double alpha,
+													 const vector<double>* topic_alphas=nullptr);
 
-	static vector<double> TopicProportion(Author* author, double alpha);
+	// Log topic proportions of the author, with kernels instantiated
+	// for common topic numbers (16, 32, 50, 64, 100 and 128).
+	static vector<double> TopicProportion(
+			Author* author,
+			double alpha,
+			const vector<double>* topic_alphas=nullptr);
+	// The same in log_pr, which holds the topic number of the author.
+	static void TopicProportion(Author* author,
+															double alpha,
+															const vector<double>* topic_alphas,
+															double* log_pr);
 
 	static void SaveAuthor(Author* author, ofstream& ofs);
+
+private:
+	// Fill log_pr for TOPIC_NO topics, or for topic_no topics
+	// if TOPIC_NO is 0, with topic_alphas if not null.
+	template <int TOPIC_NO>
+	static void TopicProportionSized(Author* author,
+																	 double alpha,
+																	 const double* topic_alphas,
+																	 int topic_no,
+																	 double* log_pr);
 };
 
 
@@ -118,9 +185,8 @@ public:
 class AllAuthors {
 
 public:
-	static AllAuthors& GetInstance();
+	AllAuthors() {}
 
-public:
 	AllAuthors(const AllAuthors& from) = delete;
 	AllAuthors& operator=(const AllAuthors& from) = delete;
 
@@ -132,21 +198,27 @@ public:
 
 	void clearAllAuthors() { authors_.resize(0); }
 
+	// Number of authors with dense topic counts.
+	int getDenseAuthors() const;
+	// Memory of the topic counts of all authors in bytes.
+	size_t getBytes() const;
+
 private:
 	// All authors.
 	vector<Author> authors_;
-
-	// Private constructor.
-	AllAuthors() {}
 };
 
 class AllAuthorsUtils {
 public:
-	static double AlphaScores(double alpha);
+	static double AlphaScores(AllAuthors* all_authors,
+														double alpha,
+														const vector<double>* topic_alphas=nullptr);
 
-	static void SaveAuthors(const string& filename_authors);
+	static void SaveAuthors(AllAuthors* all_authors,
+													const string& filename_authors);
 
-	static void LoadAuthors(const string& filename_authors);
+	static void LoadAuthors(AllAuthors* all_authors,
+													const string& filename_authors);
 };
 
 }  // namespace atm
@@ -0,0 +1,49 @@
+#include <math.h>
+
+#include "convergence_monitor.h"
+
+namespace atm {
+
+// =======================================================================
+// ConvergenceMonitor
+// =======================================================================
+
+ConvergenceMonitor::ConvergenceMonitor()
+    : window_(0),
+      tolerance_(1e-4),
+      patience_(5),
+      change_(-1.0),
+      stalled_(0) {
+}
+
+void ConvergenceMonitor::reset() {
+  values_.clear();
+  change_ = -1.0;
+  stalled_ = 0;
+}
+
+bool ConvergenceMonitor::update(double value) {
+  if (!isEnabled()) return false;
+
+  values_.push_back(value);
+  int size = values_.size();
+  if (size < 2 * window_) return false;
+
+  double last = 0.0;
+  double previous = 0.0;
+  for (int i = 0; i < window_; i++) {
+    last += values_[size - 1 - i];
+    previous += values_[size - 1 - window_ - i];
+  }
+  change_ = (previous != 0.0) ? fabs(last - previous) / fabs(previous)
+                              : fabs(last);
+
+  if (change_ < tolerance_) {
+    stalled_++;
+  } else {
+    stalled_ = 0;
+  }
+  return stalled_ >= patience_;
+}
+
+}  // namespace atm
@@ -0,0 +1,56 @@
+#ifndef CONVERGENCE_MONITOR_H_
+#define CONVERGENCE_MONITOR_H_
+
+#include <vector>
+
+using namespace std;
+
+namespace atm {
+
+// Convergence test on a value computed every iteration, the Gibbs score
+// in training and the perplexity in inference.
+// The relative change is between the means of the last window values
+// and of the window before,
+//   |mean(last window) - mean(previous window)| / |mean(previous window)|,
+// which smooths out the noise of the sampler. The run has converged once
+// the change has stayed below the tolerance for patience consecutive
+// iterations. A window of 0 disables the test.
+class ConvergenceMonitor {
+ public:
+  ConvergenceMonitor();
+
+  void setWindow(int window) { window_ = window; }
+  int getWindow() const { return window_; }
+  void setTolerance(double tolerance) { tolerance_ = tolerance; }
+  double getTolerance() const { return tolerance_; }
+  void setPatience(int patience) { patience_ = patience; }
+  int getPatience() const { return patience_; }
+
+  bool isEnabled() const { return window_ > 0; }
+
+  // Forget the values, to monitor another run.
+  void reset();
+
+  // Add the value of an iteration and return true if the run has
+  // converged.
+  bool update(double value);
+
+  // Relative change after the last update, -1 until two windows of
+  // values have been added.
+  double getChange() const { return change_; }
+
+ private:
+  int window_;
+  double tolerance_;
+  int patience_;
+
+  vector<double> values_;
+  double change_;
+
+  // Consecutive iterations with a change below the tolerance.
+  int stalled_;
+};
+
+}  // namespace atm
+
+#endif  // CONVERGENCE_MONITOR_H_
@@ -2,17 +2,19 @@
 #include <assert.h>
 #include <gsl/gsl_permutation.h>
 #include <math.h>
+#include <stdlib.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <set>
 
 #include "corpus.h"
 #include "author.h"
 #include "document.h"
-
-#define BUF_SIZE 10000
+#include "model_context.h"
 
 namespace atm {
 
@@ -22,93 +24,295 @@ namespace atm {
 
 Corpus::Corpus()
     : word_no_(0),
+      original_word_no_(0),
       word_total_(0),
-      author_no_(0) {
+      author_no_(0),
+      word_offsets_(1, 0),
+      author_offsets_(1, 0) {
+}
+
+void Corpus::addDocument(int id,
+                         const vector<int>& author_ids,
+                         const vector<TokenIndex>& words) {
+  const TokenIndex* old_words = words_.data();
+  const int* old_author_ids = author_ids_.data();
+  words_.insert(words_.end(), words.begin(), words.end());
+  author_ids_.insert(author_ids_.end(), author_ids.begin(), author_ids.end());
+  word_offsets_.push_back(words_.size());
+  author_offsets_.push_back(author_ids_.size());
+
+  // The arrays have grown to a new place, point the views to it.
+  if (words_.data() != old_words || author_ids_.data() != old_author_ids) {
+    for (size_t d = 0; d < documents_.size(); d++) {
+      documents_[d].words_ = words_.data() + word_offsets_[d];
+      documents_[d].author_ids_ = author_ids_.data() + author_offsets_[d];
+    }
+  }
+
+  int d = documents_.size();
+  documents_.emplace_back(id, words_.data() + word_offsets_[d], words.size(),
+                          author_ids_.data() + author_offsets_[d],
+                          author_ids.size());
+  order_.push_back(d);
+}
+
+void Corpus::setWordMap(vector<int>&& word_map, int original_word_no) {
+  word_map_ = move(word_map);
+  original_word_no_ = original_word_no;
+  word_no_ = word_map_.size();
+}
+
+void Corpus::permuteDocuments(const size_t* order) {
+  int size = order_.size();
+  order_buffer_.resize(size);
+  for (int i = 0; i < size; i++) {
+    order_buffer_[i] = order_[order[i]];
+  }
+  order_.swap(order_buffer_);
+}
+
+size_t Corpus::getBytes() const {
+  return (word_offsets_.size() + words_.size()) * sizeof(TokenIndex) +
+         (author_offsets_.size() + author_ids_.size() + 2 * order_.size()) *
+             sizeof(int) +
+         documents_.size() * sizeof(Document);
 }
 
 // =======================================================================
 // CorpusUtils
 // =======================================================================
 
-void CorpusUtils::ReadCorpus(
+void CorpusUtils::CheckCorpusSize(long total_word_count,
+                                  const vector<long>& author_words,
+                                  const vector<long>& word_occurrences) {
+  if (total_word_count > numeric_limits<TokenIndex>::max()) {
+    cout << "The corpus has " << total_word_count << " words, more than "
+         << numeric_limits<TokenIndex>::max()
+         << ": rebuild with make TOKEN64=1" << endl;
+    exit(1);
+  }
+  for (size_t a = 0; a < author_words.size(); a++) {
+    if (author_words[a] > numeric_limits<int>::max()) {
+      cout << "Author " << a << " has " << author_words[a]
+           << " words, more than the topic counts hold" << endl;
+      exit(1);
+    }
+  }
+  for (size_t w = 0; w < word_occurrences.size(); w++) {
+    if (word_occurrences[w] > numeric_limits<int>::max()) {
+      cout << "Word " << w << " occurs " << word_occurrences[w]
+           << " times, more than the topic counts hold" << endl;
+      exit(1);
+    }
+  }
+}
+
+bool CorpusUtils::ReadDocument(ifstream& infile,
+                               ifstream& authors_infile,
+                               vector<int>* author_ids,
+                               vector<pair<int, int>>* word_counts) {
+  // Lines are read whole, a document of many distinct words is longer
+  // than any fixed buffer.
+  string line;
+  string authors_line;
+  if (!getline(infile, line) || !getline(authors_infile, authors_line)) {
+    return false;
+  }
+
+  author_ids->clear();
+  istringstream s_line_author(authors_line);
+  string entry;
+  while (getline(s_line_author, entry, ' ')) {
+    author_ids->push_back(atoi(entry.c_str()));
+  }
+
+  // The first entry is the number of distinct words, then id:count.
+  word_counts->clear();
+  istringstream s_line(line);
+  int word_count_pos = 0;
+  while (getline(s_line, entry, ' ')) {
+    if (word_count_pos > 0) {
+      istringstream s_word_count(entry);
+      string str;
+      getline(s_word_count, str, ':');
+      int word_id = atoi(str.c_str());
+      getline(s_word_count, str, ':');
+      int word_count = atoi(str.c_str());
+      word_counts->emplace_back(word_id, word_count);
+    }
+    word_count_pos++;
+  }
+  return true;
+}
+
+void CorpusUtils::ScanCorpus(
     const string& docs_filename,
     const string& authors_filename,
     Corpus* corpus,
+    ModelContext* context,
     int topic_no) {
-
   ifstream infile(docs_filename.c_str());
-  char buf[BUF_SIZE];
+  ifstream authors_infile(authors_filename.c_str());
 
+  int author_no = 0;
+  int doc_no = 0;
+  int word_no = 0;
+  long total_word_count = 0;
+  vector<long> author_words;
+  vector<long> word_occurrences;
+
+  vector<int> author_ids;
+  vector<pair<int, int>> word_counts;
+  while (ReadDocument(infile, authors_infile, &author_ids, &word_counts)) {
+    for (int author_id : author_ids) {
+      if (author_id >= author_no) {
+        author_no = author_id + 1;
+      }
+    }
+    if (author_ids.empty()) {
+      continue;
+    }
+    long doc_words = 0;
+    for (auto& word_count : word_counts) {
+      doc_words += word_count.second;
+      if (word_count.first >= word_no) {
+        word_no = word_count.first + 1;
+        word_occurrences.resize(word_no, 0);
+      }
+      word_occurrences[word_count.first] += word_count.second;
+    }
+    total_word_count += doc_words;
+    author_words.resize(author_no, 0);
+    for (int author_id : author_ids) {
+      author_words[author_id] += doc_words;
+    }
+    doc_no++;
+  }
+
+  infile.close();
+  authors_infile.close();
+
+  CheckCorpusSize(total_word_count, author_words, word_occurrences);
+
+  AllAuthors* all_authors = context->getMutableAllAuthors();
+  all_authors->clearAllAuthors();
+  for (int i = 0; i < author_no; i++) {
+    all_authors->addAuthor(i, topic_no);
+  }
+
+  corpus->setWordNo(word_no);
+  corpus->setWordTotal(total_word_count);
+  corpus->setAuthorNo(author_no);
+
+  cout << "Number of documents in corpus: " << doc_no << endl;
+  cout << "Number of authors in corpus: " << author_no << endl;
+  cout << "Number of distinct words in corpus: " << word_no << endl;
+  cout << "Number of words in corpus: " << total_word_count << endl;
+}
+
+void CorpusUtils::ReadCorpus(
+    const string& docs_filename,
+    const string& authors_filename,
+    Corpus* corpus,
+    ModelContext* context,
+    int topic_no,
+    WordGrouping grouping,
+    const vector<int>* word_ids) {
+
+  ifstream infile(docs_filename.c_str());
   ifstream authors_infile(authors_filename.c_str());
-  char authors_buf[BUF_SIZE];
 
   int author_no = 0;
   int doc_no = 0;
   int word_no = 0;
-  int total_word_count = 0;
-  int words;
-
-  AllWords& all_words = AllWords::GetInstance();
-
-  while (infile.getline(buf, BUF_SIZE) && 
-  			 authors_infile.getline(authors_buf, BUF_SIZE)) {
-  	
-  	istringstream s_line_author(authors_buf);
-    std::vector<int> author_ids;
-  	while (s_line_author.getline(authors_buf, BUF_SIZE, ' ')) {
-  		int author_id = atoi(authors_buf);
+  long total_word_count = 0;
+  long skipped_word_count = 0;
+  vector<long> author_words;
+  vector<long> word_occurrences;
+
+  AllWords* all_words = context->getMutableAllWords();
+
+  vector<int> author_ids;
+  vector<pair<int, int>> word_counts;
+  vector<TokenIndex> words;
+  while (ReadDocument(infile, authors_infile, &author_ids, &word_counts)) {
+  	for (int author_id : author_ids) {
   		if (author_id >= author_no) {
   			author_no = author_id + 1;
   		}
-  		author_ids.push_back(author_id);
   	}
 
   	if (author_ids.empty()) {
   		continue;
   	}
 
-    istringstream s_line(buf);
-    // Consider each line at a time.
-    int word_count_pos = 0;
-    Document document(doc_no);
-    // Set author ids
-    document.setAuthorIds(author_ids);
-    while (s_line.getline(buf, BUF_SIZE, ' ')) {
-      if (word_count_pos == 0) {
-        words = atoi(buf);
+    if (word_ids != nullptr) {
+      int word_id_no = word_ids->size();
+      size_t kept = 0;
+      for (auto& word_count_pair : word_counts) {
+        int word_id = word_count_pair.first;
+        if (word_id < word_id_no && (*word_ids)[word_id] != -1) {
+          word_counts[kept++] =
+              make_pair((*word_ids)[word_id], word_count_pair.second);
+        } else {
+          skipped_word_count += word_count_pair.second;
+        }
+      }
+      word_counts.resize(kept);
+    }
+
+    // Checked before the words are added, so that their indices
+    // cannot overflow.
+    long doc_words = 0;
+    for (auto& word_count_pair : word_counts) {
+      doc_words += word_count_pair.second;
+    }
+    total_word_count += doc_words;
+    if (total_word_count > numeric_limits<TokenIndex>::max()) {
+      CheckCorpusSize(total_word_count, author_words, word_occurrences);
+    }
+    author_words.resize(author_no, 0);
+    for (int author_id : author_ids) {
+      author_words[author_id] += doc_words;
+    }
+
+    bool group_words = grouping == GROUP_ALL ||
+        (grouping == GROUP_SINGLE_AUTHOR && author_ids.size() == 1);
+    words.clear();
+    for (auto& word_count_pair : word_counts) {
+      int word_id = word_count_pair.first;
+      int word_count = word_count_pair.second;
+
+      if (group_words && word_count > 1) {
+        all_words->addWordGroup(word_id, word_count);
+        words.push_back(all_words->getWordNo() - 1);
       } else {
-        int word_id, word_count;
-        istringstream s_word_count(buf);
-        string str;
-        getline(s_word_count, str, ':');
-        word_id = atoi(str.c_str());
-        getline(s_word_count, str, ':');
-        word_count = atoi(str.c_str());
-        total_word_count += word_count;
-       
         for (int i = 0; i < word_count; i++) {
-          all_words.addWord(word_id);
-          document.addWord(all_words.getWordNo() - 1);
-        }
-       
-        if (word_id >= word_no) {
-          word_no = word_id + 1;
+          all_words->addWord(word_id);
+          words.push_back(all_words->getWordNo() - 1);
         }
       }
-      word_count_pos++;
+
+      if (word_id >= word_no) {
+        word_no = word_id + 1;
+        word_occurrences.resize(word_no, 0);
+      }
+      word_occurrences[word_id] += word_count;
     }
-    corpus->addDocument(move(document));
+    corpus->addDocument(doc_no, author_ids, words);
     doc_no += 1;
   }
 
   infile.close();
   authors_infile.close();
 
-  AllAuthors& all_authors = AllAuthors::GetInstance();
-  all_authors.clearAllAuthors();
+  CheckCorpusSize(total_word_count, author_words, word_occurrences);
+
+  AllAuthors* all_authors = context->getMutableAllAuthors();
+  all_authors->clearAllAuthors();
   
   for (int i = 0; i < author_no; i++) {
-    all_authors.addAuthor(i, topic_no);
+    all_authors->addAuthor(i, topic_no);
   }
 
   corpus->setWordNo(word_no);
@@ -118,8 +322,55 @@ void CorpusUtils::ReadCorpus(
   cout << "Number of documents in corpus: " << doc_no << endl;
   cout << "Number of authors in corpus: " << author_no << endl;
   cout << "Number of distinct words in corpus: " << word_no << endl;
-  cout << "Number of words in corpus: " << total_word_count << " = " 
-       << all_words.getWordNo() << endl;
+  if (grouping != GROUP_NONE) {
+    cout << "Number of words in corpus: " << total_word_count << " in "
+         << all_words->getWordNo() << " word groups" << endl;
+  } else {
+    cout << "Number of words in corpus: " << total_word_count << " = "
+         << all_words->getWordNo() << endl;
+  }
+  if (word_ids != nullptr) {
+    cout << "Words not in the model, skipped: " << skipped_word_count << endl;
+  }
+  cout << "Memory of the words: " << all_words->getBytes() << " bytes ("
+       << all_words->getWordIds().getBits() << " bits per word id)" << endl;
+  cout << "Memory of the documents: " << corpus->getBytes() << " bytes"
+       << endl;
+}
+
+void CorpusUtils::RelabelWords(Corpus* corpus, ModelContext* context) {
+  AllWords* all_words = context->getMutableAllWords();
+  int original_word_no = corpus->getWordNo();
+  TokenIndex word_no = all_words->getWordNo();
+
+  vector<long> frequencies(original_word_no, 0);
+  for (TokenIndex i = 0; i < word_no; i++) {
+    Word word = all_words->getMutableWord(i);
+    frequencies[word.getId()] += word.getCount();
+  }
+
+  // The ids that occur by decreasing frequency, ties by id.
+  vector<int> word_map;
+  for (int w = 0; w < original_word_no; w++) {
+    if (frequencies[w] > 0) {
+      word_map.push_back(w);
+    }
+  }
+  stable_sort(word_map.begin(), word_map.end(), [&](int a, int b) {
+    return frequencies[a] > frequencies[b];
+  });
+
+  vector<int> new_ids(original_word_no, -1);
+  for (size_t i = 0; i < word_map.size(); i++) {
+    new_ids[word_map[i]] = i;
+  }
+  all_words->relabelWords(new_ids);
+  corpus->setWordMap(move(word_map), original_word_no);
+
+  cout << "Relabeled the word ids by frequency: " << corpus->getWordNo()
+       << " words out of " << original_word_no << " ids" << endl;
+  cout << "Memory of the words: " << all_words->getBytes() << " bytes ("
+       << all_words->getWordIds().getBits() << " bits per word id)" << endl;
 }
 
 void CorpusUtils::SaveTrainCorpus(const string& filename_corpus,
@@ -129,10 +380,10 @@ void CorpusUtils::SaveTrainCorpus(const string& filename_corpus,
                               Corpus* corpus,
                               int doc_no) {
   ifstream infile(filename_corpus.c_str());
-  char buf[BUF_SIZE];
+  string line;
 
   ifstream authors_infile(filename_authors.c_str());
-  char authors_buf[BUF_SIZE];
+  string authors_line;
 
   ofstream ofs_corpus(filename_save);
   ofstream ofs_authors(filename_authors_save);
@@ -144,12 +395,11 @@ void CorpusUtils::SaveTrainCorpus(const string& filename_corpus,
 
   int cur_doc_no = 0;
 
-  while (infile.getline(buf, BUF_SIZE) && 
-         authors_infile.getline(authors_buf, BUF_SIZE)) {
+  while (getline(infile, line) && getline(authors_infile, authors_line)) {
     auto it = s.find(cur_doc_no++);
     if (it != end(s)) {
-      ofs_corpus << buf << endl;
-      ofs_authors << authors_buf << endl;
+      ofs_corpus << line << endl;
+      ofs_authors << authors_line << endl;
     }
   }
 
@@ -161,38 +411,51 @@ void CorpusUtils::SaveTrainCorpus(const string& filename_corpus,
 
 }
 
-void CorpusUtils::PermuteDocuments(Corpus* corpus) {
+void CorpusUtils::PermuteDocuments(Corpus* corpus, ModelContext* context) {
   int size = corpus->getDocuments();
-  vector<Document> permuted_documents;
 
   // Permute the values in perm.
-  // These values correspond to the indices of the documents in the
-  // document vector of the corpus.
+  // These values correspond to the positions of the documents in the
+  // current order of the corpus.
   gsl_permutation* perm = gsl_permutation_calloc(size);
-  Utils::Shuffle(perm, size);
+  context->getMutableRandom()->shuffle(perm, size);
   int perm_size = perm->size;
   assert(size == perm_size);
 
-  for (int i = 0; i < perm_size; i++) {
-    Document* document = corpus->getMutableDocument(perm->data[i]);
-    permuted_documents.emplace_back(move(*document));
-  }
-
-  corpus->setDocuments(move(permuted_documents));
+  corpus->permuteDocuments(perm->data);
 
   gsl_permutation_free(perm);
 }
 
-double CorpusUtils::ComputePerplexity(Corpus* corpus, 
-                                      AllTopics* all_topics,
-                                      double alpha) {
+long CorpusUtils::CountWords(Corpus* corpus,
+                              ModelContext* context,
+                              int doc_no) {
+  AllWords* all_words = context->getMutableAllWords();
+  long total_words = 0;
+  for (int i = 0; i < doc_no; i++) {
+    Document* document = corpus->getMutableDocument(i);
+    for (int j = 0; j < document->getWords(); j++) {
+      total_words += all_words->getMutableWord(document->getWord(j)).getCount();
+    }
+  }
+  return total_words;
+}
+
+double CorpusUtils::ComputePerplexity(Corpus* corpus,
+                                      ModelContext* context,
+                                      double alpha,
+                                      const vector<double>* topic_alphas) {
+  AllWords* all_words = context->getMutableAllWords();
   int doc_no = corpus->getDocuments();
   double perplexity = 0.0;
-  int total_words = 0;
+  long total_words = 0;
   for (int i = 0; i < doc_no; i++) {
     Document* document = corpus->getMutableDocument(i);
-    perplexity +=  DocumentUtils::ComputePerplexity(document, all_topics, alpha);
-    total_words += document->getWords();
+    perplexity +=  DocumentUtils::ComputePerplexity(document, context, alpha,
+                                                     topic_alphas);
+    for (int j = 0; j < document->getWords(); j++) {
+      total_words += all_words->getMutableWord(document->getWord(j)).getCount();
+    }
   }
 
   return exp(-perplexity / total_words);
@@ -1,7 +1,10 @@
 #ifndef CORPUS_H_
 #define CORPUS_H_
 
+#include <fstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "document.h"
 #include "utils.h"
@@ -9,43 +12,91 @@
 
 namespace atm {
 
+// Which occurrences of a word in a document CorpusUtils::ReadCorpus keeps
+// as one word group with a count instead of one word per occurrence.
+// A group has one author, so for the Gibbs samplers only the documents
+// with a single author are grouped, where that is exact; CVB0 groups
+// every document, the expected counts of identical words being equal.
+enum WordGrouping {
+  GROUP_NONE,
+  GROUP_SINGLE_AUTHOR,
+  GROUP_ALL
+};
+
 // A corpus containing a number of documents.
 // Local dirichlet paramter of each author - alpha.
+// The words and author ids of all the documents are stored back to
+// back in two arrays with the offsets of each document (compressed
+// sparse rows), and the documents are views into them. The documents
+// are visited in the order of an index array, so that permuting them
+// does not move their words.
 class Corpus {
  public:
   Corpus();
+  Corpus(const Corpus& from) = delete;
+  Corpus& operator=(const Corpus& from) = delete;
 
   void setWordNo(int word_no) { word_no_ = word_no; }
   int getWordNo() const { return word_no_; }
 
-  void addDocument(Document&& document) {
-    documents_.emplace_back(move(document));
-  }
-  int getDocuments() const { return documents_.size(); }
-  Document* getMutableDocument(int i) { return &documents_.at(i); }
-  void setDocuments(vector<Document>&& documents) {
-    documents_ = move(documents);
+  // Original id of each word id once the word ids have been relabeled
+  // (see CorpusUtils::RelabelWords), empty if the words keep their ids.
+  // Setting it sets the number of words to its size.
+  const vector<int>& getWordMap() const { return word_map_; }
+  void setWordMap(vector<int>&& word_map, int original_word_no);
+  // Bound of the word ids in the corpus file.
+  int getOriginalWordNo() const {
+    return word_map_.empty() ? word_no_ : original_word_no_;
   }
 
-  int getWordTotal() const { return word_total_; }
-  void setWordTotal(int word_total) { word_total_ = word_total; }
+  // Append a document with the author ids and the indices of its
+  // words in AllWords.
+  void addDocument(int id,
+                   const vector<int>& author_ids,
+                   const vector<TokenIndex>& words);
+  int getDocuments() const { return order_.size(); }
+  // The i-th document in the current order.
+  Document* getMutableDocument(int i) { return &documents_[order_.at(i)]; }
+
+  // Visit the documents in a new order, the i-th document becomes the
+  // document at position order[i] in the current order.
+  void permuteDocuments(const size_t* order);
+
+  long getWordTotal() const { return word_total_; }
+  void setWordTotal(long word_total) { word_total_ = word_total; }
 
   int getAuthorNo() const { return author_no_; }
   void setAuthorNo(const int& author_no) { author_no_ = author_no; }
 
+  // Memory of the documents in bytes.
+  size_t getBytes() const;
+
 private:
   // The number of distinct words in the corpus.
   int word_no_;
 
+  vector<int> word_map_;
+  int original_word_no_;
+
   // The number of total words in the corpus.
-  int word_total_;
+  long word_total_;
 
   // The number of authors.
   int author_no_;
 
-  // The documents in this corpus.
+  // The words of document d are words_[word_offsets_[d]] up to
+  // words_[word_offsets_[d + 1]], and the same for the author ids.
+  vector<TokenIndex> word_offsets_;
+  vector<TokenIndex> words_;
+  vector<int> author_offsets_;
+  vector<int> author_ids_;
+
+  // The documents in this corpus, in the order they were added.
   vector<Document> documents_;
 
+  // The index in documents_ of the i-th document in the current order.
+  vector<int> order_;
+  vector<int> order_buffer_;
 };
 
 
@@ -53,12 +104,57 @@ private:
 class CorpusUtils {
  public:
   // Read corpus from file.
+  // The occurrences of a word in a document are grouped as grouping
+  // says (see WordGrouping).
+  // word_ids, if given, is the id in the model of each id of the corpus
+  // file, -1 for a word the model does not have. The words are read
+  // with those ids, and the words of the ids it does not map (including
+  // those beyond its end) are skipped.
+  // The words and the authors are added to the context.
   static void ReadCorpus(
       const string& filename,
       const string& authors_filename,
       Corpus* corpus,
+      ModelContext* context,
+      int topic_no,
+      WordGrouping grouping = GROUP_NONE,
+      const vector<int>* word_ids = nullptr);
+
+  // Read the corpus statistics (distinct words, authors and words) and
+  // create the authors, without keeping the words of the documents.
+  static void ScanCorpus(
+      const string& filename,
+      const string& authors_filename,
+      Corpus* corpus,
+      ModelContext* context,
       int topic_no);
 
+  // The number of words in the first doc_no documents of the corpus.
+  static long CountWords(Corpus* corpus, ModelContext* context, int doc_no);
+
+  // Stop the program if the corpus has more words than TokenIndex
+  // holds, or if an author (from the words of its documents) or a word
+  // has more words than the int topic counts hold.
+  static void CheckCorpusSize(long total_word_count,
+                              const vector<long>& author_words,
+                              const vector<long>& word_occurrences);
+
+  // Read the next document line and author line, the author ids and
+  // the (word id, count) pairs of the document.
+  // Returns false at the end of either file.
+  static bool ReadDocument(ifstream& infile,
+                           ifstream& authors_infile,
+                           vector<int>* author_ids,
+                           vector<pair<int, int>>* word_counts);
+
+  // Relabel the word ids by decreasing number of occurrences in the
+  // corpus, 0 for the most frequent word, and drop the ids that do not
+  // occur. The model then runs on the compact ids, so that the counts
+  // of the frequent words are next to each other and the topics have
+  // one count per word of the vocabulary. The map back to the original
+  // ids is kept in the corpus for saving.
+  static void RelabelWords(Corpus* corpus, ModelContext* context);
+
   static void SaveTrainCorpus(const string& filename_corpus,
                               const string& filename_authors,
                               const string& filename_save,
@@ -68,11 +164,13 @@ class CorpusUtils {
 
 
   // Permute the documents in the corpus.
-  static void PermuteDocuments(Corpus* corpus);
+  static void PermuteDocuments(Corpus* corpus, ModelContext* context);
 
-  static double ComputePerplexity(Corpus* corpus, 
-                                  AllTopics* all_topics,
-                                  double alpha);
+  // topic_alphas, if given, replaces alpha with one alpha per topic.
+  static double ComputePerplexity(Corpus* corpus,
+                                  ModelContext* context,
+                                  double alpha,
+                                  const vector<double>* topic_alphas=nullptr);
 };
 
 } // atm
@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <fstream>
+#include <iostream>
+
+#include "cvb0.h"
+#include "author.h"
+#include "gibbs.h"
+#include "utils.h"
+
+namespace atm {
+
+// =======================================================================
+// CVB0
+// =======================================================================
+
+CVB0::CVB0()
+    : tolerance_(1e-3),
+      alpha_(0.0),
+      eta_(0.0),
+      topics_(0),
+      terms_(0),
+      all_words_(nullptr),
+      tokens_(0) {
+}
+
+void CVB0::init(GibbsState* gibbs_state, int doc_no) {
+  Corpus* corpus = gibbs_state->getMutableCorpus();
+  ModelContext* context = gibbs_state->getMutableContext();
+  AllTopics* all_topics = context->getMutableAllTopics();
+  all_words_ = context->getMutableAllWords();
+  Random* random = context->getMutableRandom();
+  assert(doc_no <= corpus->getDocuments());
+
+  alpha_ = gibbs_state->getAlpha();
+  topics_ = all_topics->getTopics();
+  assert(topics_ > 0);
+  eta_ = all_topics->getMutableTopic(0)->getEta();
+  terms_ = corpus->getWordNo();
+
+  author_topic_.assign(static_cast<long>(corpus->getAuthorNo()) * topics_, 0.0);
+  author_sum_.assign(corpus->getAuthorNo(), 0.0);
+  topic_word_.assign(static_cast<long>(terms_) * topics_, 0.0);
+  topic_sum_.assign(topics_, 0.0);
+
+  // Lay out the responsibilities of the word groups.
+  documents_.clear();
+  offsets_.assign(doc_no, vector<long>());
+  tokens_ = 0;
+  long size = 0;
+  int max_authors = 1;
+  for (int d = 0; d < doc_no; d++) {
+    Document* document = corpus->getMutableDocument(d);
+    documents_.push_back(document);
+    int authors = document->getAuthors();
+    if (authors > max_authors) {
+      max_authors = authors;
+    }
+    for (int i = 0; i < document->getWords(); i++) {
+      offsets_[d].push_back(size);
+      size += static_cast<long>(authors) * topics_;
+      tokens_ += all_words_->getMutableWord(document->getWord(i)).getCount();
+    }
+  }
+  gamma_.resize(size);
+  weights_.resize(static_cast<long>(max_authors) * topics_);
+
+  // Random responsibilities.
+  for (int d = 0; d < doc_no; d++) {
+    Document* document = documents_[d];
+    int pairs = document->getAuthors() * topics_;
+    for (int i = 0; i < document->getWords(); i++) {
+      Word word = all_words_->getMutableWord(document->getWord(i));
+      float* gamma = &gamma_[offsets_[d][i]];
+      double sum = 0.0;
+      for (int j = 0; j < pairs; j++) {
+        gamma[j] = random->uniform() + 1e-3;
+        sum += gamma[j];
+      }
+      for (int j = 0; j < pairs; j++) {
+        gamma[j] /= sum;
+      }
+      updateCounts(document, word.getId(), word.getCount(), gamma, 1);
+    }
+  }
+
+  cout << "CVB0 responsibilities: " << size << " for "
+       << tokens_ << " tokens" << endl;
+}
+
+void CVB0::updateCounts(Document* document,
+                        int word_id,
+                        double count,
+                        const float* gamma,
+                        int update) {
+  double* topic_word = &topic_word_[static_cast<long>(word_id) * topics_];
+  double scale = update * count;
+  for (int j = 0; j < document->getAuthors(); j++) {
+    int author_id = document->getAuthorId(j);
+    double* author_topic =
+        &author_topic_[static_cast<long>(author_id) * topics_];
+    const float* author_gamma = gamma + j * topics_;
+    double author_sum = 0.0;
+    for (int k = 0; k < topics_; k++) {
+      double expected = scale * author_gamma[k];
+      author_topic[k] += expected;
+      topic_word[k] += expected;
+      topic_sum_[k] += expected;
+      author_sum += expected;
+    }
+    author_sum_[author_id] += author_sum;
+  }
+}
+
+double CVB0::iterate() {
+  double change = 0.0;
+  double v_eta = terms_ * eta_;
+  double k_alpha = topics_ * alpha_;
+
+  for (size_t d = 0; d < documents_.size(); d++) {
+    Document* document = documents_[d];
+    int authors = document->getAuthors();
+    int pairs = authors * topics_;
+
+    for (int i = 0; i < document->getWords(); i++) {
+      Word word = all_words_->getMutableWord(document->getWord(i));
+      int word_id = word.getId();
+      double count = word.getCount();
+      float* gamma = &gamma_[offsets_[d][i]];
+
+      // Remove the word, then compute its new responsibilities from the
+      // remaining expected counts.
+      updateCounts(document, word_id, count, gamma, -1);
+
+      const double* topic_word =
+          &topic_word_[static_cast<long>(word_id) * topics_];
+      double sum = 0.0;
+      for (int j = 0; j < authors; j++) {
+        int author_id = document->getAuthorId(j);
+        const double* author_topic =
+            &author_topic_[static_cast<long>(author_id) * topics_];
+        double norm = 1.0 / (author_sum_[author_id] + k_alpha);
+        double* weights = &weights_[j * topics_];
+        for (int k = 0; k < topics_; k++) {
+          weights[k] = norm * (author_topic[k] + alpha_) *
+                       (topic_word[k] + eta_) / (topic_sum_[k] + v_eta);
+          sum += weights[k];
+        }
+      }
+
+      double word_change = 0.0;
+      for (int j = 0; j < pairs; j++) {
+        float new_gamma = weights_[j] / sum;
+        word_change += fabs(new_gamma - gamma[j]);
+        gamma[j] = new_gamma;
+      }
+      change += count * word_change;
+
+      updateCounts(document, word_id, count, gamma, 1);
+    }
+  }
+
+  return (tokens_ > 0) ? change / tokens_ : 0.0;
+}
+
+void CVB0::exportCounts(GibbsState* gibbs_state) {
+  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
+  AllAuthors* all_authors =
+      gibbs_state->getMutableContext()->getMutableAllAuthors();
+
+  for (int k = 0; k < topics_; k++) {
+    Topic* topic = all_topics->getMutableTopic(k);
+    TokenIndex topic_word_no = 0;
+    for (int w = 0; w < terms_; w++) {
+      int count = lround(topic_word_[static_cast<long>(w) * topics_ + k]);
+      topic->setWordCount(w, count);
+      topic_word_no += count;
+    }
+    topic->setTopicWordNo(topic_word_no);
+  }
+  all_topics->indexWordTopics();
+
+  for (int a = 0; a < all_authors->getAuthors(); a++) {
+    Author* author = all_authors->getMutableAuthor(a);
+    for (int k = 0; k < topics_; k++) {
+      author->setTopicCounts(
+          k, lround(author_topic_[static_cast<long>(a) * topics_ + k]));
+    }
+  }
+}
+
+void CVB0::train(GibbsState* gibbs_state, int doc_no, int max_iter) {
+  init(gibbs_state, doc_no);
+
+  char filename_other[100];
+  char filename_topics[100];
+  char filename_topics_count[100];
+  ofstream ofs("result/train-likelihood.dat");
+  ConvergenceMonitor* monitor = gibbs_state->getMutableConvergenceMonitor();
+
+  for (int i = 0; i < max_iter; i++) {
+    gibbs_state->incIteration(1);
+    clock_t start = clock();
+    double change = iterate();
+    double time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+    exportCounts(gibbs_state);
+    double score = gibbs_state->computeGibbsScore();
+
+    cout << "CVB0 iteration " << gibbs_state->getIteration()
+         << ": change = " << change << ", time = " << time << "s" << endl;
+    cout << "Gibbs score at iteration "
+         << gibbs_state->getIteration() << " = " << score << endl;
+    ofs << score << endl;
+
+    sprintf(filename_other, "result/train.other");
+    sprintf(filename_topics, "result/train-topics-%3d.dat", i);
+    sprintf(filename_topics_count, "result/train-topics-counts-%3d.dat", i);
+    if (i % 100 == 0) {
+      GibbsSampler::SaveState(gibbs_state, filename_other, filename_topics,
+                              filename_topics_count);
+    }
+
+    if (change < tolerance_) {
+      cout << "CVB0 converged at iteration "
+           << gibbs_state->getIteration() << endl;
+      break;
+    }
+    if (monitor->update(score)) {
+      GibbsSampler::PrintConvergence(gibbs_state, "Gibbs score");
+      break;
+    }
+  }
+  ofs.close();
+}
+
+}  // namespace atm
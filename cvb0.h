@@ -0,0 +1,85 @@
+#ifndef CVB0_H_
+#define CVB0_H_
+
+#include <vector>
+
+#include "document.h"
+
+using namespace std;
+
+namespace atm {
+
+class GibbsState;
+
+// Collapsed variational (CVB0) training of the author-topic model.
+// Instead of a sampled author and topic, every word group of a document
+// keeps responsibilities gamma over the (author, topic) pairs of the
+// document, and the author-topic and topic-word counts are the expected
+// counts under gamma. One pass updates every word deterministically:
+//   gamma(a, k) ~ (n_ak + alpha) / (n_a + K alpha) *
+//                 (n_kw + eta) / (n_k + V eta)
+// with the counts of the word itself removed. The update of a word is a
+// dense loop over topics on contiguous counts.
+// Training stops when the mean change of gamma per token falls below the
+// tolerance, which usually takes far fewer passes than Gibbs sampling, or
+// when the convergence monitor of the Gibbs state stops it.
+class CVB0 {
+ public:
+  CVB0();
+
+  // Train on the first doc_no documents of the Gibbs state, writing
+  // the likelihood and the topics checkpoints of
+  // GibbsSampler::TrainByPart. The expected counts are rounded into the
+  // topics and authors of the Gibbs state.
+  void train(GibbsState* gibbs_state, int doc_no, int max_iter);
+
+  void setTolerance(double tolerance) { tolerance_ = tolerance; }
+  double getTolerance() const { return tolerance_; }
+
+ private:
+  // Random responsibilities and the expected counts they give.
+  void init(GibbsState* gibbs_state, int doc_no);
+
+  // Update the responsibilities of all the words once and return the
+  // mean L1 change of the responsibilities per token.
+  double iterate();
+
+  // Add (update = 1) or remove (update = -1) the expected counts of the
+  // word group with the given responsibilities.
+  void updateCounts(Document* document, int word_id, double count,
+                    const float* gamma, int update);
+
+  // Round the expected counts into the topics and authors.
+  void exportCounts(GibbsState* gibbs_state);
+
+  double tolerance_;
+  double alpha_;
+  double eta_;
+  int topics_;
+  int terms_;
+
+  // Words of the model, documents and their number of tokens.
+  AllWords* all_words_;
+  vector<Document*> documents_;
+  long tokens_;
+
+  // Offset of the responsibilities of each word group of each document,
+  // the responsibilities of a group are authors x topics floats.
+  vector<vector<long>> offsets_;
+  vector<float> gamma_;
+
+  // Expected counts n_ak (authors x topics) and n_a.
+  vector<double> author_topic_;
+  vector<double> author_sum_;
+
+  // Expected counts n_kw (words x topics, word-major) and n_k.
+  vector<double> topic_word_;
+  vector<double> topic_sum_;
+
+  // Scratch for the new responsibilities of a word.
+  vector<double> weights_;
+};
+
+}  // namespace atm
+
+#endif  // CVB0_H_
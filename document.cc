@@ -1,7 +1,7 @@
 #include <assert.h>
 #include <math.h>
 
-#include <gsl/gsl_permutation.h>
+#include <algorithm>
 #include <gsl/gsl_sf.h>
 #include <iostream>
 #include <functional>   
@@ -11,77 +11,70 @@
 #include "document.h"
 #include "utils.h"
 #include "author.h"
+#include "model_context.h"
 #include "topic.h"
 
 
 namespace atm {
 
-// =======================================================================
-// Word
-// =======================================================================
-
-Word::Word(int id, int author_id, int topic_id)
-		: id_(id),
-		  author_id_(author_id),
-		  topic_id_(topic_id) {
-}
-
-Word::Word(int id) 
-		: id_(id),
-		  author_id_(-1),
-		  topic_id_(-1) {
-
-}
-
-bool Word::operator==(const Word& word) {
-	return (id_ == word.id_) and
-				 (author_id_ == word.author_id_) and
-				 (topic_id_ == word.topic_id_);
-}
-
 // =======================================================================
 // WordUtils
 // =======================================================================
 
 void WordUtils::UpdateAuthorFromWord(
-			int word_idx,
+			Document* document,
+			TokenIndex word_idx,
 			int update,
-			AllTopics* all_topics,
+			ModelContext* context,
 			bool inf) {
-	AllWords& all_words = AllWords::GetInstance();
-	Word* word = all_words.getMutableWord(word_idx);
+	AllWords* all_words = context->getMutableAllWords();
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Word word = all_words->getMutableWord(word_idx);
 
-	if (word->getAuthorId() == -1 && update == -1) {
+	if (word.getAuthorSlot() == -1 && update == -1) {
 			return;
 	}
 
-	AllAuthors& all_authors = AllAuthors::GetInstance();
-	Author* author = all_authors.getMutableAuthor(word->getAuthorId());
+	Author* author = context->getMutableAllAuthors()->getMutableAuthor(
+			document->getAuthorId(word.getAuthorSlot()));
 	if (update == -1) {	
-		int topic_id = word->getTopicId();
+		if (word.getCount() > 1) {
+			// Remove every occurrence of the group from its topic.
+			int* unit_topics = all_words->getMutableUnitTopics(word_idx);
+			for (int i = 0; i < word.getCount(); i++) {
+				if (unit_topics[i] != -1) {
+					author->updateTopicCounts(unit_topics[i], update);
+					if (not inf) {
+						all_topics->updateWordCount(unit_topics[i], word.getId(), update);
+					}
+				}
+				unit_topics[i] = -1;
+			}
+		}
+
+		int topic_id = word.getTopicId();
 		if (topic_id != -1) {
 			// Update topic_id count.
 			author->updateTopicCounts(topic_id, update);	
 
 			if (not inf) {
 				// Update topic statistics.
-				Topic* topic = all_topics->getMutableTopic(topic_id);
-				topic->updateWordCount(word->getId(), update);
+				all_topics->updateWordCount(topic_id, word.getId(), update);
 			}	
 		}
 		
 		// Remove word from author.
-		author->removeWord(word_idx);
+		author->removeWord(word_idx, all_words);
 
-		// Reset author id and topic_id.
-		word->setAuthorId(-1);
-		word->setTopicId(-1);
+		// Reset author slot and topic_id.
+		word.setAuthorSlot(-1);
+		word.setTopicId(-1);
 		return;
 	}
 
 	if (update == 1) {
-		author->addWord(word_idx);
-		word->setTopicId(-1);
+		author->addWord(word_idx, all_words);
+		word.setTopicId(-1);
 	}
 }
 
@@ -89,93 +82,170 @@ void WordUtils::UpdateAuthorFromWord(
 // AllWords
 // =======================================================================
 
-AllWords& AllWords::GetInstance() {
-	static AllWords instance;
-	return instance;
+void AllWords::addWord(int word_id) {
+	word_ids_.push_back(word_id);
+	author_slots_.push_back(0);
+	topic_ids_.push_back(0);
+	counts_.push_back(1);
+	author_positions_.push_back(0);
+	++word_no_;
 }
 
+void AllWords::addWordGroup(int word_id, int count) {
+	assert(count > 1);
+	unit_offsets_.resize(word_ids_.size(), -1);
+	unit_offsets_.push_back(unit_topics_.size());
+	unit_topics_.resize(unit_topics_.size() + count, -1);
+	addWord(word_id);
+	counts_.set(word_ids_.size() - 1, count);
+}
 
-// =======================================================================
-// Document
-// =======================================================================
-Document::Document(int id)
-		: id_(id){
+size_t AllWords::getBytes() const {
+	return word_ids_.getBytes() + author_slots_.getBytes() +
+			topic_ids_.getBytes() + counts_.getBytes() +
+			author_positions_.getBytes() +
+			unit_offsets_.size() * sizeof(TokenIndex) +
+			unit_topics_.size() * sizeof(int);
 }
 
+void AllWords::relabelWords(const vector<int>& word_map) {
+	// Repacked from scratch, so that the ids take the bits of the new
+	// vocabulary.
+	int max_id = 0;
+	for (int word_id : word_map) {
+		max_id = max(max_id, word_id);
+	}
+	PackedArray word_ids;
+	word_ids.assign(word_ids_.size(), max_id);
+	for (size_t i = 0; i < word_ids_.size(); i++) {
+		word_ids.set(i, word_map[word_ids_.get(i)]);
+	}
+	word_ids_ = move(word_ids);
+}
+
+void AllWords::compactTopics(const vector<int>& topic_map) {
+	for (size_t i = 0; i < topic_ids_.size(); i++) {
+		int topic_id = static_cast<int>(topic_ids_.get(i)) - 1;
+		if (topic_id != -1) {
+			topic_ids_.set(i, topic_map[topic_id] + 1);
+		}
+	}
+	for (auto& unit_topic : unit_topics_) {
+		if (unit_topic != -1) {
+			unit_topic = topic_map[unit_topic];
+		}
+	}
+}
 
 
 // =======================================================================
 // DocumentUtils
 // =======================================================================
 
-void DocumentUtils::PermuteWords(Document* document) {
+void DocumentUtils::PermuteWords(Document* document, ModelContext* context) {
+  context->getMutableRandom()->shuffle(document->getMutableWords(),
+                                       document->getWords());
+}
+
+void DocumentUtils::SortWords(Document* document, ModelContext* context) {
+  AllWords* all_words = context->getMutableAllWords();
   int size = document->getWords();
-  vector<int> permuted_words;
-
-  // Permute the values in perm.
-  // These values correspond to the indices of the words in the
-  // word vector of the document.
-  gsl_permutation* perm = gsl_permutation_calloc(size);
-  Utils::Shuffle(perm, size);
-  int perm_size = perm->size;
-  assert(size == perm_size);
-
-  for (int i = 0; i < perm_size; i++) {
-  	int word = document->getWord(perm->data[i]);
-    permuted_words.push_back(word);
+  vector<pair<int, TokenIndex>>& sort_keys = *context->getMutableSortKeys();
+  sort_keys.clear();
+  for (int i = 0; i < size; i++) {
+    TokenIndex word_idx = document->getWord(i);
+    sort_keys.emplace_back(all_words->getMutableWord(word_idx).getId(),
+                           word_idx);
   }
 
-  document->setWords(move(permuted_words));
+  sort(sort_keys.begin(), sort_keys.end());
 
-  gsl_permutation_free(perm);
+  TokenIndex* words = document->getMutableWords();
+  for (int i = 0; i < size; i++) {
+    words[i] = sort_keys[i].second;
+  }
 }
 
 
-void DocumentUtils::SampleAuthors(Document* document, 
-																	AllTopics* all_topics,
-																	bool inf) {
-	int authors = document->getAuthors();
-	std::vector<double> log_pr(authors, log(1.0 / authors));
-	
-	AllWords& all_words = AllWords::GetInstance();
+template <int AUTHORS>
+void DocumentUtils::SampleAuthorsSized(Document* document,
+																			 ModelContext* context,
+																			 bool inf) {
+	int authors = (AUTHORS > 0) ? AUTHORS : document->getAuthors();
+	AllWords* all_words = context->getMutableAllWords();
+	Random* random = context->getMutableRandom();
 
 	for (int i = 0; i < document->getWords(); i++) {
-		int word_idx = document->getWord(i);
-		Word* word = all_words.getMutableWord(word_idx);
-
+		TokenIndex word_idx = document->getWord(i);
+		Word word = all_words->getMutableWord(word_idx);
+
+		// Sample the author uniformly, a single author needs no draw.
+		int author_slot;
+		if (AUTHORS == 1) {
+			author_slot = 0;
+		} else if (AUTHORS == 2) {
+			author_slot = random->uniform() < 0.5 ? 0 : 1;
+		} else {
+			author_slot = random->uniformInt(authors);
+		}
 
-		// Sample author id uniformly.
-		int author_id = Utils::SampleFromLogPr(log_pr);
-		if (author_id != word->getAuthorId()) {
-			WordUtils::UpdateAuthorFromWord(word_idx, -1, all_topics, inf);
-			word->setAuthorId(author_id);
-			WordUtils::UpdateAuthorFromWord(word_idx, 1, all_topics, inf);
+		if (author_slot != word.getAuthorSlot()) {
+			WordUtils::UpdateAuthorFromWord(document, word_idx, -1, context, inf);
+			word.setAuthorSlot(author_slot);
+			WordUtils::UpdateAuthorFromWord(document, word_idx, 1, context, inf);
 		}
 	}
 }
 
+void DocumentUtils::SampleAuthors(Document* document, 
+																	ModelContext* context,
+																	bool inf) {
+	switch (document->getAuthors()) {
+		case 1:
+			SampleAuthorsSized<1>(document, context, inf);
+			break;
+		case 2:
+			SampleAuthorsSized<2>(document, context, inf);
+			break;
+		default:
+			SampleAuthorsSized<0>(document, context, inf);
+			break;
+	}
+}
+
 double DocumentUtils::ComputePerplexity(
 													Document* document,
-													AllTopics* all_topics,
-													double alpha) {
-	AllWords& all_words = AllWords::GetInstance();
-	AllAuthors& all_authors = AllAuthors::GetInstance();
+													ModelContext* context,
+													double alpha,
+													const vector<double>* topic_alphas) {
+	AllWords* all_words = context->getMutableAllWords();
+	AllAuthors* all_authors = context->getMutableAllAuthors();
+	AllTopics* all_topics = context->getMutableAllTopics();
 	int word_no = document->getWords();
 
 	double perplexity = 0.0;
+	int topic_no = all_topics->getTopics();
+	vector<double>& topic_pr = *context->getMutableTopicPr();
+	vector<double>& word_pr = *context->getMutableLogPr();
+	topic_pr.resize(topic_no);
+	word_pr.resize(topic_no);
 
 	for (int i = 0; i < word_no; i++) {
-		int word_idx = document->getWord(i);
-		Word* word = all_words.getMutableWord(word_idx);
+		TokenIndex word_idx = document->getWord(i);
+		Word word = all_words->getMutableWord(word_idx);
 
-		int author_id = word->getAuthorId();
-		Author* author = all_authors.getMutableAuthor(author_id);
+		int author_id = document->getAuthorId(word.getAuthorSlot());
+		Author* author = all_authors->getMutableAuthor(author_id);
 
-		vector<double> topic_pr = AuthorUtils::TopicProportion(author, alpha);
-		vector<double> word_pr = AllTopicsUtils::WordProbabilities(all_topics, word->getId());
+		AuthorUtils::TopicProportion(author, alpha, topic_alphas, topic_pr.data());
+		AllTopicsUtils::WordProbabilities(all_topics, word.getId(), word_pr.data());
 
-		perplexity = inner_product(begin(topic_pr), end(topic_pr), begin(word_pr), 
-															 perplexity, plus<double>(), Utils::LogSum);
+		// log sum_k theta_ak phi_kw, from the first topic on.
+		// A word group counts once per occurrence.
+		perplexity += word.getCount() *
+				inner_product(begin(topic_pr) + 1, end(topic_pr), begin(word_pr) + 1,
+											topic_pr[0] + word_pr[0], Utils::LogSum,
+											plus<double>());
 
 	}
 
@@ -1,116 +1,212 @@
 #ifndef DOCUMENT_H_
 #define DOCUMENT_H_
 
+#include <assert.h>
+
 #include <string>
 #include <vector>
 
+#include "packed_array.h"
+#include "token_index.h"
+
 using namespace std;
 
 namespace atm {
 
-// A word having an id, a word count, author id,
-// and the topic_id the word is assigned to.
+class AllWords;
+class AllTopics;
+class Document;
+class ModelContext;
+
+// A view of a word of AllWords, which stores the words as arrays.
+// A word has an id, an author given by its slot in the authors of its
+// document, and the topic_id the word is assigned to.
+// Views are cheap to copy and all refer to the same stored word.
+// A word with a count above 1 is a group of occurrences of the same
+// word in a document, all assigned to the same author. The topic of
+// each occurrence is kept in AllWords::getMutableUnitTopics and the
+// topic_id of the group is unused.
 class Word {
 public:
-	Word(int id, int author_id, int topic_id);
-	Word(int id);
+	Word(AllWords* all_words, TokenIndex idx)
+			: all_words_(all_words), idx_(idx) {}
 
-	bool operator==(const Word& word);
+	int getId() const;
 
-	void setId(int id) { id_ = id; }
-	int getId() const { return id_; }
+	// Index of the author in Document::getAuthorId, -1 without an author.
+	void setAuthorSlot(int author_slot);
+	int getAuthorSlot() const;
 
-	void setAuthorId(int author_id) { author_id_ = author_id; }
-	int getAuthorId() const { return author_id_; }
+	void setTopicId(int topic_id);
+	int getTopicId() const;
 
-	void setTopicId(int topic_id) { topic_id_ = topic_id; }
-	int getTopicId() const { return topic_id_; }
+	int getCount() const;
 
-private:
-	// Word id.
-	int id_;
-
-	// Author id the word is assigned to.
-	int author_id_;
+	// Position of the word in the words of its author, kept by Author.
+	void setAuthorPos(int author_pos);
+	int getAuthorPos() const;
 
-	// Corresonding topic id.
-	int topic_id_;
+private:
+	AllWords* all_words_;
+	TokenIndex idx_;
 };
 
-class AllTopics;
-
 class WordUtils {
 public:
+	// Remove the word from its author and topic (update = -1), or add it
+	// to the author of its slot in the document (update = 1).
 	static void UpdateAuthorFromWord(
-			int word_idx,
+			Document* document,
+			TokenIndex word_idx,
 			int update,
-			AllTopics* all_topics,
+			ModelContext* context,
 			bool inf = false);
 };
 
 // AllWords contains all the words in the corpus,
 // each word has unique index in the corpus.
+// The fields of the words are kept in separate bit packed arrays
+// (structure of arrays): the word id in log2(vocabulary) bits, the
+// author slot in log2(authors of a document) bits and the topic in
+// log2(topics) bits, so that a sweep streams a few bytes per word.
+// Word gives a view of one word.
 class AllWords {
 public:
-	static AllWords& GetInstance();
-public:
+	AllWords() : word_no_(0) {}
+
 	AllWords(const AllWords& from) = delete;
 	AllWords& operator=(const AllWords& from) = delete;
 
-	int getWordNo() const { return word_no_; }
-	void setWordNo(const int& word_no) { word_no_ = word_no; }
+	TokenIndex getWordNo() const { return word_no_; }
+	void setWordNo(const TokenIndex& word_no) { word_no_ = word_no; }
 	void updateWordNo(int update) { word_no_ += update; }
 
-	void addWord(int word_id, int author_id = -1, int topic_id = -1) {
-		words_.emplace_back(Word(word_id, author_id, topic_id));
-		++word_no_;
+	// Add a word without author and topic.
+	void addWord(int word_id);
+
+	// Add a group of count occurrences of the word,
+	// the topics of the occurrences start unassigned.
+	void addWordGroup(int word_id, int count);
+
+	Word getMutableWord(TokenIndex i) { return Word(this, i); }
+
+	// Topics of the occurrences of the word group i.
+	int* getMutableUnitTopics(TokenIndex i) {
+		return &unit_topics_[unit_offsets_[i]];
 	}
 
-	Word* getMutableWord(int i) { return &words_[i]; }
+	// Replace the id of every word with word_map[id].
+	void relabelWords(const vector<int>& word_map);
+
+	// Renumber the topics of the words, topic_map[k] is the new id of
+	// topic k; words of a topic mapped to -1 are left without a topic.
+	void compactTopics(const vector<int>& topic_map);
+
+	// Arrays of the fields of the words, indexed by word. The author
+	// slot, topic id and author position are stored plus one, 0 when
+	// unassigned.
+	const PackedArray& getWordIds() const { return word_ids_; }
+	const PackedArray& getAuthorSlots() const { return author_slots_; }
+	const PackedArray& getTopicIds() const { return topic_ids_; }
+
+	// Memory of the word arrays in bytes.
+	size_t getBytes() const;
 
 private:
+	friend class Word;
+
 	// Number of words.
-	int word_no_;
+	TokenIndex word_no_;
+
+	PackedArray word_ids_;
+	PackedArray author_slots_;
+	PackedArray topic_ids_;
+	PackedArray counts_;
+	PackedArray author_positions_;
 
-	// All the words.
-	vector<Word> words_;
+	// Offset of the unit topics of each word group, indexed by word.
+	// Only filled up to the last word group.
+	vector<TokenIndex> unit_offsets_;
 
-	AllWords() {}
+	// Topics of the occurrences of all the word groups.
+	vector<int> unit_topics_;
 };
 
+inline int Word::getId() const {
+	return all_words_->word_ids_.get(idx_);
+}
+
+inline void Word::setAuthorSlot(int author_slot) {
+	all_words_->author_slots_.set(idx_, author_slot + 1);
+}
+
+inline int Word::getAuthorSlot() const {
+	return static_cast<int>(all_words_->author_slots_.get(idx_)) - 1;
+}
+
+inline void Word::setTopicId(int topic_id) {
+	all_words_->topic_ids_.set(idx_, topic_id + 1);
+}
+
+inline int Word::getTopicId() const {
+	return static_cast<int>(all_words_->topic_ids_.get(idx_)) - 1;
+}
+
+inline int Word::getCount() const {
+	return all_words_->counts_.get(idx_);
+}
+
+inline void Word::setAuthorPos(int author_pos) {
+	all_words_->author_positions_.set(idx_, author_pos + 1);
+}
+
+inline int Word::getAuthorPos() const {
+	return static_cast<int>(all_words_->author_positions_.get(idx_)) - 1;
+}
+
 // The document containing a number of words and authors.
 // A document has an id.
+// A view of a document of a Corpus, which stores the words and the
+// author ids of all the documents back to back. The words can be
+// reordered in place but not added.
 class Document {
 public:
-	Document(int id);
-	Document(const Document& from) = default;
-	Document& operator=(const Document& from) = default;
-
-	Document(Document&& from) = default;
-	Document& operator=(Document&& from) = default;
+	Document(int id, TokenIndex* words, int word_count,
+					 const int* author_ids, int author_count)
+			: id_(id),
+			  words_(words),
+			  word_count_(word_count),
+			  author_ids_(author_ids),
+			  author_count_(author_count) {}
 
 	int getId() const { return id_; }
 	
-	int getWords() const { return words_.size(); }
-	int getAuthors() const { return author_ids_.size(); }
+	int getWords() const { return word_count_; }
+	int getAuthors() const { return author_count_; }
 
-	void addWord(int word) { words_.push_back(word); }
-	int getWord(int i) { return words_.at(i); }
-	void setWords(vector<int>&& words) { words_ = move(words); }
-
-	int getAuthorId(int i) const { return author_ids_.at(i); }
-	void addAuthorId(const int author_id) { author_ids_.push_back(author_id); } 
+	TokenIndex getWord(int i) const {
+		assert(i >= 0 && i < word_count_);
+		return words_[i];
+	}
+	TokenIndex* getMutableWords() { return words_; }
 
-	void setAuthorIds(const std::vector<int>& author_ids) { author_ids_ = author_ids; }
+	int getAuthorId(int i) const {
+		assert(i >= 0 && i < author_count_);
+		return author_ids_[i];
+	}
 private:
+	friend class Corpus;
+
 	// Document id.
 	int id_;
 
 	// The words in the documnet
-	vector<int> words_;
+	TokenIndex* words_;
+	int word_count_;
 
 	// Author ids of the document.
-	vector<int> author_ids_;
+	const int* author_ids_;
+	int author_count_;
 };
 
 // The class provides functionality for permuting words
@@ -118,17 +214,30 @@ private:
 class DocumentUtils {
 public:
 	// Permute the words in a document.
-	static void PermuteWords(Document* document);
+	static void PermuteWords(Document* document, ModelContext* context);
 
-	// Sample author id
+	// Sort the words in a document by word id.
+	static void SortWords(Document* document, ModelContext* context);
+
+	// Sample the authors of the words uniformly
+	// from the authors of the document.
 	static void SampleAuthors(Document* document, 
-														AllTopics* all_topics,
+														ModelContext* context,
 														bool inf=false);
 
 	static double ComputePerplexity(Document* document,
-																AllTopics* all_topics,
-																double alpha);
+																ModelContext* context,
+																double alpha,
+																const vector<double>* topic_alphas=nullptr);
 
+private:
+	// Sample author ids for a document with AUTHORS authors, or any
+	// number of authors if AUTHORS is 0. Most documents have one or
+	// two authors.
+	template <int AUTHORS>
+	static void SampleAuthorsSized(Document* document,
+																 ModelContext* context,
+																 bool inf);
 };
 
 }  // namespace atm
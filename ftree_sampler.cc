@@ -0,0 +1,178 @@
+#include <assert.h>
+
+#include "ftree_sampler.h"
+#include "model_context.h"
+#include "utils.h"
+
+namespace atm {
+
+// =======================================================================
+// FTree
+// =======================================================================
+
+FTree::FTree()
+		: size_(0),
+		  leaf_no_(1),
+		  tree_(2, 0.0) {
+}
+
+void FTree::build(const vector<double>& weights) {
+	size_ = weights.size();
+	leaf_no_ = 1;
+	while (leaf_no_ < size_) {
+		leaf_no_ *= 2;
+	}
+
+	tree_.assign(2 * leaf_no_, 0.0);
+	for (int i = 0; i < size_; i++) {
+		tree_[leaf_no_ + i] = weights[i];
+	}
+	for (int i = leaf_no_ - 1; i > 0; i--) {
+		tree_[i] = tree_[2 * i] + tree_[2 * i + 1];
+	}
+}
+
+void FTree::set(int i, double weight) {
+	int node = leaf_no_ + i;
+	double delta = weight - tree_[node];
+	for (; node > 0; node /= 2) {
+		tree_[node] += delta;
+	}
+}
+
+int FTree::sample(double rand_no) const {
+	int node = 1;
+	while (node < leaf_no_) {
+		int left = 2 * node;
+		if (rand_no < tree_[left]) {
+			node = left;
+		} else {
+			rand_no -= tree_[left];
+			node = left + 1;
+		}
+	}
+
+	// Rounding can only lead into the zero padding on the right.
+	int i = node - leaf_no_;
+	return (i < size_) ? i : size_ - 1;
+}
+
+// =======================================================================
+// FTreeSampler
+// =======================================================================
+
+FTreeSampler::FTreeSampler()
+		: alpha_(0.0) {
+}
+
+void FTreeSampler::initAuthor(Author* author,
+															double alpha,
+															AllTopics* all_topics) {
+	int topics = all_topics->getTopics();
+	alpha_ = alpha;
+	denominators_.resize(topics);
+	weights_.resize(topics);
+	word_pr_.resize(topics);
+
+	for (int i = 0; i < topics; i++) {
+		Topic* topic = all_topics->getMutableTopic(i);
+		double eta = topic->getEta();
+		denominators_[i] = eta * topic->getCorpusWordNo() +
+											 topic->getTopicWordNo();
+		weights_[i] = alpha * eta / denominators_[i];
+	}
+	for (int i = 0; i < author->getNonzeroTopics(); i++) {
+		int topic_id = author->getNonzeroTopic(i);
+		double eta = all_topics->getMutableTopic(topic_id)->getEta();
+		weights_[topic_id] = (author->getNonzeroCount(i) + alpha) * eta /
+												 denominators_[topic_id];
+	}
+	tree_.build(weights_);
+}
+
+void FTreeSampler::updateTopic(Author* author,
+															 Word word,
+															 int update,
+															 AllTopics* all_topics,
+															 bool inf) {
+	int topic_id = word.getTopicId();
+	if (topic_id == -1) {
+		return;
+	}
+
+	AuthorUtils::UpdateTopicFromWord(author, word, update, all_topics, inf);
+
+	Topic* topic = all_topics->getMutableTopic(topic_id);
+	double eta = topic->getEta();
+	denominators_[topic_id] = eta * topic->getCorpusWordNo() +
+														topic->getTopicWordNo();
+	tree_.set(topic_id, (author->getTopicCounts(topic_id) + alpha_) * eta /
+											denominators_[topic_id]);
+}
+
+void FTreeSampler::sampleTopic(Author* author,
+															 TokenIndex word_idx,
+															 bool remove,
+															 ModelContext* context,
+															 bool inf) {
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Word word = context->getMutableAllWords()->getMutableWord(word_idx);
+	if (remove) {
+		updateTopic(author, word, -1, all_topics, inf);
+	}
+
+	// Word part over the topics the word is assigned to.
+	int word_id = word.getId();
+	const vector<int>& word_topics = all_topics->getWordTopics(word_id);
+	int word_topic_no = word_topics.size();
+	double word_sum = 0.0;
+	for (int i = 0; i < word_topic_no; i++) {
+		int topic_id = word_topics[i];
+		word_pr_[i] = (author->getTopicCounts(topic_id) + alpha_) *
+									all_topics->getWordTopicCount(word_id, i) /
+									denominators_[topic_id];
+		word_sum += word_pr_[i];
+	}
+
+	double rand_no = context->getMutableRandom()->uniform() *
+									 (word_sum + tree_.getSum());
+	int sample_topic_id = -1;
+
+	if (rand_no < word_sum) {
+		for (int i = 0; i < word_topic_no; i++) {
+			sample_topic_id = word_topics[i];
+			rand_no -= word_pr_[i];
+			if (rand_no <= 0.0) break;
+		}
+	} else {
+		sample_topic_id = tree_.sample(rand_no - word_sum);
+	}
+	assert(sample_topic_id != -1);
+
+	word.setTopicId(sample_topic_id);
+	updateTopic(author, word, 1, all_topics, inf);
+}
+
+void FTreeSampler::sampleTopics(Author* author,
+																int permute_words,
+																bool remove,
+																double alpha,
+																ModelContext* context,
+																bool inf) {
+	int author_word_count = author->getWords();
+	if (author_word_count == 0) return;
+
+	// Permute the words in the author.
+	if (permute_words == 1) {
+		AuthorUtils::PermuteWords(author, context);
+	}
+
+	initAuthor(author, alpha, context->getMutableAllTopics());
+
+	for (int i = 0; i < author_word_count; i++) {
+		TokenIndex word_idx = author->getWord(i);
+		sampleTopic(author, word_idx, remove, context, inf);
+	}
+}
+
+}  // namespace atm
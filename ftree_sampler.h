@@ -0,0 +1,96 @@
+#ifndef FTREE_SAMPLER_H_
+#define FTREE_SAMPLER_H_
+
+#include <vector>
+
+#include "author.h"
+#include "topic.h"
+
+using namespace std;
+
+namespace atm {
+
+// F+ tree (Yu et al., 2015): a complete binary tree stored in an array,
+// the leaves hold nonnegative weights and each inner node the sum of
+// its children. Changing a weight and drawing an index proportional to
+// the weights both cost O(log size).
+class FTree {
+public:
+	FTree();
+
+	// Build the tree over the weights, O(size).
+	void build(const vector<double>& weights);
+
+	void set(int i, double weight);
+	double get(int i) const { return tree_[leaf_no_ + i]; }
+	double getSum() const { return tree_[1]; }
+
+	// Draw an index, rand_no is uniform in [0, getSum()).
+	int sample(double rand_no) const;
+
+private:
+	// Number of weights.
+	int size_;
+
+	// Number of leaves, the smallest power of two >= size_.
+	int leaf_no_;
+
+	// Node i has children 2i and 2i + 1, the root is node 1
+	// and weight i is stored at node leaf_no_ + i.
+	vector<double> tree_;
+};
+
+// Topic sampler keeping the author part of the conditional
+//   (n_ak + alpha) (n_kw + eta) / (n_k + V eta)
+// in an F+ tree. The conditional is split into
+//   tree  (n_ak + alpha) eta / (n_k + V eta) for every topic,
+//   word  (n_ak + alpha) n_kw / (n_k + V eta) for topics with n_kw > 0.
+// The tree is built once per author, a count change updates it in
+// O(log topics) and a word costs O(nonzero topics of the word + log topics).
+// Draws from the same distribution as AuthorUtils::SampleTopics.
+class FTreeSampler {
+public:
+	FTreeSampler();
+
+	// Sample the word topics for a given author,
+	// with the same arguments as AuthorUtils::SampleTopics.
+	void sampleTopics(Author* author,
+										int permute_words,
+										bool remove,
+										double alpha,
+										ModelContext* context,
+										bool inf=false);
+
+private:
+	// Build the tree and per-topic caches for the author.
+	void initAuthor(Author* author, double alpha, AllTopics* all_topics);
+
+	void sampleTopic(Author* author,
+									 TokenIndex word_idx,
+									 bool remove,
+									 ModelContext* context,
+									 bool inf);
+
+	// Add (update = 1) or remove (update = -1) the word from its topic
+	// and update the tree leaf of that topic.
+	void updateTopic(Author* author,
+									 Word word,
+									 int update,
+									 AllTopics* all_topics,
+									 bool inf);
+
+	double alpha_;
+
+	FTree tree_;
+
+	// n_k + V eta for each topic.
+	vector<double> denominators_;
+
+	// Scratch space for the tree weights and the word part.
+	vector<double> weights_;
+	vector<double> word_pr_;
+};
+
+}  // namespace atm
+
+#endif  // FTREE_SAMPLER_H_
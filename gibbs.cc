@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
 
 #include <fstream>
 #include <iostream>
@@ -7,16 +8,20 @@
 #include <vector>
 
 #include "gibbs.h"
+#include "alloc_counter.h"
 #include "author.h"
+#include "sample_kernel.h"
 
 #define REP_NO 300
-#define DEFAULT_HYPER_LAG 0
+#define DEFAULT_HYPER_LAG 10
 #define DEFAULT_SHUFFLE_LAG 100
 #define DEFAULT_SAMPLE_ALPHA 0
 #define DEFAULT_SAMPLE_ETA 0
 #define BUF_SIZE 30000
 
 const int MAX_ITER_INF = 1000;
+// The original id of each word id of a relabeled model, one per line.
+const char WORD_MAP_FILENAME[] = "result/train-word-map.dat";
 const int MAX_ITER_TRAIN = 2000;
 
 namespace atm {
@@ -35,14 +40,23 @@ GibbsState::GibbsState()
       shuffle_lag_(DEFAULT_SHUFFLE_LAG),
       hyper_lag_(DEFAULT_HYPER_LAG),
       sample_eta_(0),
-      sample_alpha_(0) {
+      sample_alpha_(0),
+      sampler_(SAMPLER_LINEAR),
+      sweep_order_(SWEEP_SHUFFLED),
+      sweep_tile_(0),
+      selective_sweeps_(0),
+      engine_(ENGINE_GIBBS),
+      prune_topics_(0),
+      author_time_(0.0),
+      sweep_allocations_(0) {
 }
 
 
 double GibbsState::computeGibbsScore() {
   // Compute the alpha, Eta scores.
-  alpha_score_ = AllAuthorsUtils::AlphaScores(alpha_);
-  eta_score_ = AllTopicsUtils::EtaScores(&all_topics_);
+  alpha_score_ = AllAuthorsUtils::AlphaScores(
+      context_.getMutableAllAuthors(), alpha_, getTopicAlphas());
+  eta_score_ = AllTopicsUtils::EtaScores(context_.getMutableAllTopics());
 
   score_ = alpha_score_ + eta_score_;
   // cout << "Alpha_score: " << alpha_score_ << endl;
@@ -57,6 +71,18 @@ double GibbsState::computeGibbsScore() {
   return score_;
 }
 
+void GibbsState::setTopicAlphas(const vector<double>& topic_alphas) {
+  topic_alphas_ = topic_alphas;
+  linear_sampler_.setTopicAlphas(topic_alphas_);
+  if (!topic_alphas_.empty()) {
+    double sum = 0.0;
+    for (double topic_alpha : topic_alphas_) {
+      sum += topic_alpha;
+    }
+    alpha_ = sum / topic_alphas_.size();
+  }
+}
+
 // =======================================================================
 // GibbsUtils
 // =======================================================================
@@ -71,7 +97,30 @@ void GibbsSampler::ReadGibbsInput(
   char buf[BUF_SIZE];
 
   int sample_eta = 0, sample_alpha = 0, topic_no = 0;
+  int hyper_lag = DEFAULT_HYPER_LAG;
   double alpha =  1.0, eta = 1.0;
+  SamplerType sampler = SAMPLER_LINEAR;
+  int mh_steps = 1;
+  int joint_mh_authors = 4;
+  int group_words = 0;
+  SweepOrder sweep_order = SWEEP_SHUFFLED;
+  int sweep_tile = 0;
+  int selective_sweeps = 0;
+  int selective_burn_in = 100;
+  int selective_max_period = 8;
+  double selective_author_churn = 0.3;
+  EngineType engine = ENGINE_GIBBS;
+  double cvb0_tolerance = 1e-3;
+  int online_batch = 256;
+  int online_epochs = 1;
+  double online_tau = 1.0;
+  double online_kappa = 0.6;
+  int online_local_passes = 5;
+  int prune_topics = 0;
+  int prune_window = 50;
+  int prune_max_words = 0;
+  TopicLayout topic_layout = TOPIC_LAYOUT_TOPIC;
+  int relabel_words = 0;
 
   while (infile.getline(buf, BUF_SIZE)) {
     istringstream s_line(buf);
@@ -88,64 +137,467 @@ void GibbsSampler::ReadGibbsInput(
       sample_eta = atoi(value.c_str());
     } else if (str.compare("SAMPLE_ALPHA") == 0) {
       sample_alpha = atoi(value.c_str());
+    } else if (str.compare("HYPER_LAG") == 0) {
+      hyper_lag = atoi(value.c_str());
     } else if (str.compare("TOPIC_NO") == 0) {
     	topic_no = atoi(value.c_str());
+    } else if (str.compare("SAMPLER") == 0) {
+      if (value.compare("dense") == 0) {
+        sampler = SAMPLER_DENSE;
+      } else if (value.compare("sparse") == 0) {
+        sampler = SAMPLER_SPARSE;
+      } else if (value.compare("alias") == 0) {
+        sampler = SAMPLER_ALIAS;
+      } else if (value.compare("ftree") == 0) {
+        sampler = SAMPLER_FTREE;
+      } else if (value.compare("joint") == 0) {
+        sampler = SAMPLER_JOINT;
+      } else {
+        sampler = SAMPLER_LINEAR;
+      }
+    } else if (str.compare("MH_STEPS") == 0) {
+      mh_steps = atoi(value.c_str());
+    } else if (str.compare("JOINT_MH_AUTHORS") == 0) {
+      joint_mh_authors = atoi(value.c_str());
+    } else if (str.compare("GROUP_WORDS") == 0) {
+      group_words = atoi(value.c_str());
+    } else if (str.compare("SWEEP_ORDER") == 0) {
+      if (value.compare("sorted") == 0) {
+        sweep_order = SWEEP_SORTED;
+      } else {
+        sweep_order = SWEEP_SHUFFLED;
+      }
+    } else if (str.compare("SWEEP_TILE") == 0) {
+      sweep_tile = atoi(value.c_str());
+    } else if (str.compare("SELECTIVE_SWEEPS") == 0) {
+      selective_sweeps = atoi(value.c_str());
+    } else if (str.compare("SELECTIVE_BURN_IN") == 0) {
+      selective_burn_in = atoi(value.c_str());
+    } else if (str.compare("SELECTIVE_MAX_PERIOD") == 0) {
+      selective_max_period = atoi(value.c_str());
+    } else if (str.compare("SELECTIVE_AUTHOR_CHURN") == 0) {
+      selective_author_churn = atof(value.c_str());
+    } else if (str.compare("ENGINE") == 0) {
+      if (value.compare("cvb0") == 0) {
+        engine = ENGINE_CVB0;
+      } else if (value.compare("online") == 0) {
+        engine = ENGINE_ONLINE;
+      } else {
+        engine = ENGINE_GIBBS;
+      }
+    } else if (str.compare("CVB0_TOLERANCE") == 0) {
+      cvb0_tolerance = atof(value.c_str());
+    } else if (str.compare("ONLINE_BATCH") == 0) {
+      online_batch = atoi(value.c_str());
+    } else if (str.compare("ONLINE_EPOCHS") == 0) {
+      online_epochs = atoi(value.c_str());
+    } else if (str.compare("ONLINE_TAU") == 0) {
+      online_tau = atof(value.c_str());
+    } else if (str.compare("ONLINE_KAPPA") == 0) {
+      online_kappa = atof(value.c_str());
+    } else if (str.compare("ONLINE_LOCAL_PASSES") == 0) {
+      online_local_passes = atoi(value.c_str());
+    } else if (str.compare("PRUNE_TOPICS") == 0) {
+      prune_topics = atoi(value.c_str());
+    } else if (str.compare("PRUNE_WINDOW") == 0) {
+      prune_window = atoi(value.c_str());
+    } else if (str.compare("PRUNE_MAX_WORDS") == 0) {
+      prune_max_words = atoi(value.c_str());
+    } else if (str.compare("RELABEL_WORDS") == 0) {
+      relabel_words = atoi(value.c_str());
+    } else if (str.compare("TOPIC_LAYOUT") == 0) {
+      topic_layout = ReadTopicLayout(value);
+    } else if (ReadConvergenceSetting(gibbs_state, str, value)) {
+      continue;
+    } else if (str.compare("SIMD") == 0) {
+      if (value.compare("scalar") == 0) {
+        SampleKernel::SetIsa(KERNEL_SCALAR);
+      } else if (value.compare("avx2") == 0) {
+        SampleKernel::SetIsa(KERNEL_AVX2);
+      } else {
+        SampleKernel::SetIsa(KERNEL_AVX512);
+      }
     }
   }
 
   infile.close();
 
+  // Word groups are only sampled by the linear sampler.
+  if (group_words == 1 && sampler != SAMPLER_LINEAR) {
+    cout << "GROUP_WORDS uses the linear sampler" << endl;
+    sampler = SAMPLER_LINEAR;
+  }
+
+  // So are selective sweeps.
+  if (selective_sweeps == 1 && sampler != SAMPLER_LINEAR) {
+    cout << "SELECTIVE_SWEEPS uses the linear sampler" << endl;
+    sampler = SAMPLER_LINEAR;
+  }
+
+  // So is an asymmetric alpha.
+  if (sample_alpha == 2 && sampler != SAMPLER_LINEAR) {
+    cout << "SAMPLE_ALPHA 2 uses the linear sampler" << endl;
+    sampler = SAMPLER_LINEAR;
+  }
+
+  // A word is visited at least every sweep.
+  if (selective_max_period < 1) {
+    cout << "SELECTIVE_MAX_PERIOD " << selective_max_period
+         << " is below 1, using 1" << endl;
+    selective_max_period = 1;
+  }
+
+  // A topic is pruned after being small for at least one iteration.
+  if (prune_window < 1) {
+    cout << "PRUNE_WINDOW " << prune_window << " is below 1, using 1" << endl;
+    prune_window = 1;
+  }
+
+  // A word group has one author, so the samplers only group the words
+  // of single-author documents. CVB0 keeps one set of (author, topic)
+  // responsibilities per word group and groups all of them.
+  WordGrouping grouping = GROUP_NONE;
+  if (engine == ENGINE_CVB0) {
+    grouping = GROUP_ALL;
+  } else if (group_words == 1) {
+    grouping = GROUP_SINGLE_AUTHOR;
+  }
+
+  // The online engine streams the documents with their original ids.
+  if (relabel_words == 1 && engine == ENGINE_ONLINE) {
+    cout << "RELABEL_WORDS is not used by the online engine" << endl;
+    relabel_words = 0;
+  }
+
   // Create corpus.
+  // The online engine streams the documents, only the statistics
+  // of the corpus are read here.
   Corpus* corpus = gibbs_state->getMutableCorpus();
-  CorpusUtils::ReadCorpus(filename_corpus, filename_authors, corpus, topic_no);
+  ModelContext* context = gibbs_state->getMutableContext();
+  if (engine == ENGINE_ONLINE) {
+    CorpusUtils::ScanCorpus(filename_corpus, filename_authors, corpus,
+                            context, topic_no);
+  } else {
+    CorpusUtils::ReadCorpus(filename_corpus, filename_authors, corpus,
+                            context, topic_no, grouping);
+    if (relabel_words == 1) {
+      CorpusUtils::RelabelWords(corpus, context);
+    }
+  }
 
   // Create all topics.
   AllTopics* all_topics = gibbs_state->getMutableAllTopics();
+  all_topics->setLayout(topic_layout);
+  all_topics->reserveTopics(topic_no);
   for (int i = 0; i < topic_no; i++) {
   	all_topics->addTopic(corpus->getWordNo(), eta);
   }
 
   gibbs_state->setSampleEta(sample_eta);
   gibbs_state->setSampleAlpha(sample_alpha);
+  gibbs_state->setHyperLag(hyper_lag);
   gibbs_state->setAlpha(alpha);
+  if (sample_alpha == 2) {
+    gibbs_state->setTopicAlphas(vector<double>(topic_no, alpha));
+  }
+  gibbs_state->setSampler(sampler);
+  gibbs_state->setSweepOrder(sweep_order);
+  gibbs_state->setSweepTile(sweep_tile);
+  gibbs_state->setSelectiveSweeps(selective_sweeps);
+  gibbs_state->setEngine(engine);
+  gibbs_state->getMutableCVB0()->setTolerance(cvb0_tolerance);
+  OnlineATM* online_atm = gibbs_state->getMutableOnlineATM();
+  online_atm->setBatchSize(online_batch);
+  online_atm->setEpochs(online_epochs);
+  online_atm->setTau(online_tau);
+  online_atm->setKappa(online_kappa);
+  online_atm->setLocalPasses(online_local_passes);
+  gibbs_state->setPruneTopics(prune_topics);
+  gibbs_state->getMutableTopicPruner()->setWindow(prune_window);
+  gibbs_state->getMutableTopicPruner()->setMaxWords(prune_max_words);
+  if (selective_sweeps == 1) {
+    SweepScheduler* sweep_scheduler = gibbs_state->getMutableSweepScheduler();
+    sweep_scheduler->setBurnIn(selective_burn_in);
+    sweep_scheduler->setMaxPeriod(selective_max_period);
+    sweep_scheduler->setAuthorChurn(selective_author_churn);
+    sweep_scheduler->init(context->getMutableAllWords()->getWordNo(),
+                          corpus->getAuthorNo());
+  }
+  if (sampler == SAMPLER_LINEAR) {
+    cout << "Sampling kernel: " << SampleKernel::GetIsaName() << endl;
+  }
+  gibbs_state->getMutableAliasSampler()->setMHSteps(mh_steps);
+  gibbs_state->getMutableJointSampler()->setMHSteps(mh_steps);
+  gibbs_state->getMutableJointSampler()->setMHAuthors(joint_mh_authors);
 
 }
 
-void GibbsSampler::InitGibbsState(
-    GibbsState* gibbs_state) {
+bool GibbsSampler::ReadConvergenceSetting(GibbsState* gibbs_state,
+                                          const string& key,
+                                          const string& value) {
+  ConvergenceMonitor* monitor = gibbs_state->getMutableConvergenceMonitor();
+  if (key.compare("CONVERGENCE_WINDOW") == 0) {
+    monitor->setWindow(atoi(value.c_str()));
+  } else if (key.compare("CONVERGENCE_TOLERANCE") == 0) {
+    monitor->setTolerance(atof(value.c_str()));
+  } else if (key.compare("CONVERGENCE_PATIENCE") == 0) {
+    monitor->setPatience(atoi(value.c_str()));
+  } else {
+    return false;
+  }
+  return true;
+}
 
-  Corpus* corpus = gibbs_state->getMutableCorpus();
-  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
+TopicLayout GibbsSampler::ReadTopicLayout(const string& value) {
+  if (value.compare("word") == 0) {
+    return TOPIC_LAYOUT_WORD;
+  } else if (value.compare("hybrid") == 0) {
+    return TOPIC_LAYOUT_HYBRID;
+  }
+  return TOPIC_LAYOUT_TOPIC;
+}
+
+void GibbsSampler::PrintConvergence(GibbsState* gibbs_state,
+                                    const string& value_name) {
+  ConvergenceMonitor* monitor = gibbs_state->getMutableConvergenceMonitor();
+  cout << "Converged at iteration " << gibbs_state->getIteration()
+       << ": the " << value_name << " changed by " << monitor->getChange()
+       << " over the last " << monitor->getWindow()
+       << " iterations, below " << monitor->getTolerance() << " for "
+       << monitor->getPatience() << " iterations" << endl;
+}
+
+void GibbsSampler::SampleTopics(GibbsState* gibbs_state,
+                                Author* author,
+                                int permute_words,
+                                bool remove,
+                                bool inf) {
+  ModelContext* context = gibbs_state->getMutableContext();
   double alpha = gibbs_state->getAlpha();
 
-  // Permute Authors in the corpus.
-  CorpusUtils::PermuteDocuments(corpus);
+  // The author phase appends and removes words, so the sorted order is
+  // restored before every sweep.
+  if (gibbs_state->getSweepOrder() == SWEEP_SORTED) {
+    AuthorUtils::SortWords(author, context);
+    permute_words = 0;
+  }
+
+  switch (gibbs_state->getSampler()) {
+    case SAMPLER_LINEAR:
+      gibbs_state->getMutableLinearSampler()->sampleTopics(
+          author, permute_words, remove, alpha, context, inf);
+      break;
+    case SAMPLER_SPARSE:
+      gibbs_state->getMutableSparseSampler()->sampleTopics(
+          author, permute_words, remove, alpha, context, inf);
+      break;
+    case SAMPLER_ALIAS:
+      gibbs_state->getMutableAliasSampler()->sampleTopics(
+          author, permute_words, remove, alpha, context, inf);
+      break;
+    case SAMPLER_FTREE:
+      gibbs_state->getMutableFTreeSampler()->sampleTopics(
+          author, permute_words, remove, alpha, context, inf);
+      break;
+    case SAMPLER_DENSE:
+    default:
+      AuthorUtils::SampleTopics(author, permute_words, remove, alpha,
+                                context, inf);
+      break;
+  }
+}
 
-  for (int i = 0; i < corpus->getDocuments(); i++) {
+double GibbsSampler::SampleAuthorsAndTopics(GibbsState* gibbs_state,
+                                            int doc_no,
+                                            int permute_words,
+                                            bool remove,
+                                            bool inf) {
+  Corpus* corpus = gibbs_state->getMutableCorpus();
+  ModelContext* context = gibbs_state->getMutableContext();
+  long allocations = AllocCounter::GetAllocations();
+
+  if (gibbs_state->getSampler() == SAMPLER_JOINT) {
+    JointSampler* joint_sampler = gibbs_state->getMutableJointSampler();
+    double alpha = gibbs_state->getAlpha();
+    clock_t joint_start = clock();
+    bool sorted = (gibbs_state->getSweepOrder() == SWEEP_SORTED);
+    for (int i = 0; i < doc_no; i++) {
+      Document* document = corpus->getMutableDocument(i);
+      if (sorted) {
+        DocumentUtils::SortWords(document, context);
+      }
+      joint_sampler->sampleDocument(document, sorted ? 0 : permute_words,
+                                    alpha, context, inf);
+    }
+    gibbs_state->setSweepAllocations(
+        AllocCounter::GetAllocations() - allocations);
+    return static_cast<double>(clock() - joint_start) / CLOCKS_PER_SEC;
+  }
+
+  clock_t author_start = clock();
+  for (int i = 0; i < doc_no; i++) {
     Document* document = corpus->getMutableDocument(i);
-    DocumentUtils::SampleAuthors(document, all_topics);
+    DocumentUtils::SampleAuthors(document, context, inf);
   }
+  gibbs_state->setAuthorTime(
+      static_cast<double>(clock() - author_start) / CLOCKS_PER_SEC);
 
-  AllAuthors& all_authors = AllAuthors::GetInstance();
+  AllAuthors* all_authors = context->getMutableAllAuthors();
+
+  clock_t topic_start = clock();
+  if (gibbs_state->getSelectiveSweeps() == 1) {
+    for (int i = 0; i < all_authors->getAuthors(); i++) {
+      Author* author = all_authors->getMutableAuthor(i);
+      SampleTopicsSelective(gibbs_state, author, permute_words, remove, inf);
+    }
+  } else if (gibbs_state->getSweepOrder() == SWEEP_SORTED &&
+             gibbs_state->getSweepTile() > 0 &&
+             gibbs_state->getSampler() == SAMPLER_LINEAR) {
+    SampleTopicsTiled(gibbs_state, remove, inf);
+  } else {
+    for (int i = 0; i < all_authors->getAuthors(); i++) {
+      Author* author = all_authors->getMutableAuthor(i);
+      SampleTopics(gibbs_state, author, permute_words, remove, inf);
+    }
+  }
+  gibbs_state->setSweepAllocations(
+      AllocCounter::GetAllocations() - allocations);
+  return static_cast<double>(clock() - topic_start) / CLOCKS_PER_SEC;
+}
 
-  for (int i = 0; i < all_authors.getAuthors(); i++) {
-    Author* author = all_authors.getMutableAuthor(i);
+void GibbsSampler::SampleTopicsSelective(GibbsState* gibbs_state,
+                                         Author* author,
+                                         int permute_words,
+                                         bool remove,
+                                         bool inf) {
+  ModelContext* context = gibbs_state->getMutableContext();
+  if (gibbs_state->getSweepOrder() == SWEEP_SORTED) {
+    AuthorUtils::SortWords(author, context);
+  } else if (permute_words == 1) {
+    AuthorUtils::PermuteWords(author, context);
+  }
+
+  SweepScheduler* sweep_scheduler = gibbs_state->getMutableSweepScheduler();
+  const vector<TokenIndex>& word_idxs = sweep_scheduler->selectWords(
+      author, gibbs_state->getIteration(), context->getMutableAllWords());
+  gibbs_state->getMutableLinearSampler()->sampleTopicList(
+      author, word_idxs, remove, gibbs_state->getAlpha(), context, inf);
+  sweep_scheduler->updateChurn(author, context->getMutableAllWords());
+}
+
+void GibbsSampler::SampleTopicsTiled(GibbsState* gibbs_state,
+                                     bool remove,
+                                     bool inf) {
+  ModelContext* context = gibbs_state->getMutableContext();
+  AllAuthors* all_authors = context->getMutableAllAuthors();
+  AllWords* all_words = context->getMutableAllWords();
+  LinearSampler* linear_sampler = gibbs_state->getMutableLinearSampler();
+  double alpha = gibbs_state->getAlpha();
+  int tile_words = gibbs_state->getSweepTile();
+  int word_no = gibbs_state->getMutableCorpus()->getWordNo();
+  int authors = all_authors->getAuthors();
+
+  // Position of the first word of each author in the current tile.
+  vector<int> positions(authors, 0);
+  for (int i = 0; i < authors; i++) {
+    AuthorUtils::SortWords(all_authors->getMutableAuthor(i), context);
+  }
+
+  for (int tile_begin = 0; tile_begin < word_no; tile_begin += tile_words) {
+    int tile_end = tile_begin + tile_words;
+    for (int i = 0; i < authors; i++) {
+      Author* author = all_authors->getMutableAuthor(i);
+      int begin = positions[i];
+      int end = begin;
+      while (end < author->getWords() &&
+             all_words->getMutableWord(author->getWord(end)).getId() < tile_end) {
+        end++;
+      }
+      if (end > begin) {
+        linear_sampler->sampleTopicRange(author, begin, end, remove, alpha,
+                                         context, inf);
+      }
+      positions[i] = end;
+    }
+  }
+}
 
-   
+void GibbsSampler::PrintSamplerStats(GibbsState* gibbs_state,
+                                     long tokens,
+                                     double topic_time) {
+  cout << "Topic sampling time at iteration "
+       << gibbs_state->getIteration() << " = " << topic_time << "s";
+  if (topic_time > 0.0) {
+    cout << " (" << static_cast<long>(tokens / topic_time) << " tokens/s)";
+  }
+  cout << endl;
 
-    // Permute the words in the current author.
-    AuthorUtils::PermuteWords(author);
+  if (gibbs_state->getSampler() != SAMPLER_JOINT) {
+    cout << "Author sampling time at iteration "
+         << gibbs_state->getIteration() << " = "
+         << gibbs_state->getAuthorTime() << "s" << endl;
+  }
 
-    
+  if (AllocCounter::IsEnabled()) {
+    cout << "Heap allocations at iteration " << gibbs_state->getIteration()
+         << " = " << gibbs_state->getSweepAllocations();
+    if (tokens > 0) {
+      cout << " (" << static_cast<double>(gibbs_state->getSweepAllocations()) /
+                          tokens << " per token)";
+    }
+    cout << endl;
+  }
 
-    // Sample topics for this author, without permuting the words
-    // in the author and without removing words from topics.
-    AuthorUtils::SampleTopics(author,
-                                0,
-                                false,
-                                alpha,
-                                all_topics);
+  if (gibbs_state->getSampler() == SAMPLER_ALIAS) {
+    AliasSampler* alias_sampler = gibbs_state->getMutableAliasSampler();
+    cout << "MH acceptance rate at iteration "
+         << gibbs_state->getIteration() << " = "
+         << alias_sampler->getAcceptanceRate() << endl;
+    alias_sampler->resetAcceptanceRate();
+  }
+  if (gibbs_state->getSampler() == SAMPLER_JOINT) {
+    JointSampler* joint_sampler = gibbs_state->getMutableJointSampler();
+    if (joint_sampler->getProposals() > 0) {
+      cout << "MH acceptance rate at iteration "
+           << gibbs_state->getIteration() << " = "
+           << joint_sampler->getAcceptanceRate() << endl;
+    }
+    joint_sampler->resetAcceptanceRate();
+  }
+  if (gibbs_state->getSelectiveSweeps() == 1) {
+    SweepScheduler* sweep_scheduler = gibbs_state->getMutableSweepScheduler();
+    cout << "Selective sweep at iteration " << gibbs_state->getIteration()
+         << ": visited " << sweep_scheduler->getVisited() << " of "
+         << sweep_scheduler->getWords() << " words, churn "
+         << sweep_scheduler->getChurn() << ", full rate authors "
+         << sweep_scheduler->getFullRateAuthors() << endl;
+    sweep_scheduler->resetStats();
+  }
+  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
+  if (all_topics->getLayout() == TOPIC_LAYOUT_HYBRID) {
+    cout << "Topic word counts at iteration " << gibbs_state->getIteration()
+         << ": " << all_topics->getDenseWords() << " dense words, "
+         << all_topics->getBytes() << " bytes" << endl;
   }
+  AllAuthors* all_authors =
+      gibbs_state->getMutableContext()->getMutableAllAuthors();
+  cout << "Author topic counts at iteration " << gibbs_state->getIteration()
+       << ": " << all_authors->getDenseAuthors() << " of "
+       << all_authors->getAuthors() << " authors dense, "
+       << all_authors->getBytes() << " bytes" << endl;
+}
+
+void GibbsSampler::InitGibbsState(
+    GibbsState* gibbs_state) {
+
+  Corpus* corpus = gibbs_state->getMutableCorpus();
+
+  // Permute Authors in the corpus.
+  CorpusUtils::PermuteDocuments(corpus, gibbs_state->getMutableContext());
+
+  // Sample authors and topics, permuting the words
+  // and without removing words from topics.
+  SampleAuthorsAndTopics(gibbs_state, corpus->getDocuments(), 1, false);
 
   // Compute the Gibbs score.
   double gibbs_score = gibbs_state->computeGibbsScore();
@@ -158,29 +610,12 @@ void GibbsSampler::InitGibbsStatePart(
     GibbsState* gibbs_state, int doc_no) {
 
   Corpus* corpus = gibbs_state->getMutableCorpus();
-  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
-  double alpha = gibbs_state->getAlpha();
 
   assert(doc_no <= corpus->getDocuments());
 
-  for (int i = 0; i < doc_no; i++) {
-    Document* document = corpus->getMutableDocument(i);
-    DocumentUtils::SampleAuthors(document, all_topics);
-  }
-
-  AllAuthors& all_authors = AllAuthors::GetInstance();
-
-  for (int i = 0; i < all_authors.getAuthors(); i++) {
-    Author* author = all_authors.getMutableAuthor(i);
-
-    // Sample topics for this author, without permuting the words
-    // in the author and without removing words from topics.
-    AuthorUtils::SampleTopics(author,
-                                0,
-                                false,
-                                alpha,
-                                all_topics);
-  }
+  // Sample authors and topics, without permuting the words
+  // and without removing words from topics.
+  SampleAuthorsAndTopics(gibbs_state, doc_no, 0, false);
 
   // Compute the Gibbs score.
   double gibbs_score = gibbs_state->computeGibbsScore();
@@ -197,10 +632,10 @@ GibbsState* GibbsSampler::InitGibbsStateRep(
   GibbsState* best_gibbs_state = nullptr;
 
   for (int i = 0; i < REP_NO; i++) {
-    // Initialize the random number generator.
-    Utils::InitRandomNumberGen(random_seed);
-
+    // Each repetition has its own model, with its own random numbers.
     GibbsState* gibbs_state = new GibbsState();
+    gibbs_state->getMutableContext()->getMutableRandom()->seed(
+        random_seed, i);
     ReadGibbsInput(gibbs_state, filename_corpus, filename_authors, filename_settings);
 
     // Initialize the Gibbs state.
@@ -224,13 +659,11 @@ GibbsState* GibbsSampler::InitGibbsStateRep(
 }
 
 void GibbsSampler::IterateGibbsStatePart(GibbsState* gibbs_state,
-                                           int rand_doc_no) {
+                                           int rand_doc_no,
+                                           long tokens) {
    assert(gibbs_state != nullptr);
 
   
-  Corpus* corpus = gibbs_state->getMutableCorpus();
-  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
-  double alpha = gibbs_state->getAlpha();
 
   gibbs_state->incIteration(1);
   int current_iteration = gibbs_state->getIteration();
@@ -245,20 +678,19 @@ void GibbsSampler::IterateGibbsStatePart(GibbsState* gibbs_state,
   }
 
 
-  for (int i = 0; i < rand_doc_no; i++) {
-    Document* document = corpus->getMutableDocument(i);
-    DocumentUtils::SampleAuthors(document, all_topics);
-  }
+  double topic_time = SampleAuthorsAndTopics(gibbs_state, rand_doc_no,
+                                             permute, true);
+
+  PrintSamplerStats(gibbs_state, tokens, topic_time);
 
-  AllAuthors& all_authors = AllAuthors::GetInstance();
+  if (gibbs_state->getPruneTopics() == 1) {
+    PruneTopics(gibbs_state);
+  }
 
-  for (int i = 0; i < all_authors.getAuthors(); i++) {
-    Author* author = all_authors.getMutableAuthor(i);
-    AuthorUtils::SampleTopics(author,
-                              permute,
-                              true,
-                              alpha,
-                              all_topics);
+  // Optimize hyper-parameters.
+  if (gibbs_state->getHyperLag() > 0 &&
+      (current_iteration % gibbs_state->getHyperLag() == 0)) {
+    OptimizeHyperParameters(gibbs_state);
   }
 
   // Compute the Gibbs score with the new parameter values.
@@ -274,36 +706,58 @@ void GibbsSampler::TrainByPart(const string& filename_corpus,
                                const string& filename_settings,
                                long random_seed,
                                int rand_doc_no) {
-   // Initialize the random number generator.
-    Utils::InitRandomNumberGen(random_seed);
-
     GibbsState* gibbs_state = new GibbsState();
+    ModelContext* context = gibbs_state->getMutableContext();
+    // Initialize the random number generator.
+    context->getMutableRandom()->seed(random_seed);
     ReadGibbsInput(gibbs_state, filename_corpus, filename_authors, filename_settings);
     Corpus* corpus = gibbs_state->getMutableCorpus();
 
-    CorpusUtils::PermuteDocuments(corpus);
+    // The online engine trains on the documents in file order and
+    // writes its own outputs.
+    if (gibbs_state->getEngine() == ENGINE_ONLINE) {
+      gibbs_state->getMutableOnlineATM()->train(
+          gibbs_state, filename_corpus, filename_authors, rand_doc_no);
+      delete gibbs_state;
+      return;
+    }
 
-    InitGibbsStatePart(gibbs_state, rand_doc_no);
+    CorpusUtils::PermuteDocuments(corpus, context);
 
     char filename[1000];
     sprintf(filename, "result/train-likelihood.dat");
     char filename_other[100];
     char filename_topics[100];
     char filename_topics_count[100];
-    
-    ofstream ofs(filename);
-
-    for (int i = 0; i < MAX_ITER_TRAIN; i++) {
-      IterateGibbsStatePart(gibbs_state, rand_doc_no);
-      ofs << gibbs_state->getScore() << endl;
-      sprintf(filename_other, "result/train.other");
-      sprintf(filename_topics, "result/train-topics-%3d.dat", i);
-      sprintf(filename_topics_count, "result/train-topics-counts-%3d.dat", i);
-      if (i % 100 == 0) {
-        SaveState(gibbs_state, filename_other, filename_topics, filename_topics_count);
+
+    if (gibbs_state->getEngine() == ENGINE_CVB0) {
+      gibbs_state->getMutableCVB0()->train(gibbs_state, rand_doc_no,
+                                           MAX_ITER_TRAIN);
+    } else {
+      InitGibbsStatePart(gibbs_state, rand_doc_no);
+      long tokens = rand_doc_no < corpus->getDocuments() ?
+          CorpusUtils::CountWords(corpus, context, rand_doc_no) :
+          corpus->getWordTotal();
+
+      ofstream ofs(filename);
+      ConvergenceMonitor* monitor = gibbs_state->getMutableConvergenceMonitor();
+
+      for (int i = 0; i < MAX_ITER_TRAIN; i++) {
+        IterateGibbsStatePart(gibbs_state, rand_doc_no, tokens);
+        ofs << gibbs_state->getScore() << endl;
+        sprintf(filename_other, "result/train.other");
+        sprintf(filename_topics, "result/train-topics-%3d.dat", i);
+        sprintf(filename_topics_count, "result/train-topics-counts-%3d.dat", i);
+        if (i % 100 == 0) {
+          SaveState(gibbs_state, filename_other, filename_topics, filename_topics_count);
+        }
+        if (monitor->update(gibbs_state->getScore())) {
+          PrintConvergence(gibbs_state, "Gibbs score");
+          break;
+        }
       }
+      ofs.close();
     }
-    ofs.close();
 
     sprintf(filename_other, "result/train.other");
     sprintf(filename_topics, "result/train-topics-final.dat");
@@ -322,7 +776,8 @@ void GibbsSampler::TrainByPart(const string& filename_corpus,
 
     string filename_author_counts_save = "result/train-author-counts-final.dat";
 
-    AllAuthorsUtils::SaveAuthors(filename_author_counts_save);
+    AllAuthorsUtils::SaveAuthors(context->getMutableAllAuthors(),
+                                 filename_author_counts_save);
 
 
 
@@ -335,8 +790,6 @@ void GibbsSampler::IterateGibbsState(GibbsState* gibbs_state, bool inf) {
 
   
   Corpus* corpus = gibbs_state->getMutableCorpus();
-  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
-  double alpha = gibbs_state->getAlpha();
 
   gibbs_state->incIteration(1);
   int current_iteration = gibbs_state->getIteration();
@@ -352,32 +805,16 @@ void GibbsSampler::IterateGibbsState(GibbsState* gibbs_state, bool inf) {
     permute = 1 - (current_iteration % shuffle_lag);
   }
 
-  for (int i = 0; i < corpus->getDocuments(); i++) {
-    Document* document = corpus->getMutableDocument(i);
-    DocumentUtils::SampleAuthors(document, all_topics, inf);
-  }
+  double topic_time = SampleAuthorsAndTopics(gibbs_state,
+                                             corpus->getDocuments(),
+                                             permute, true, inf);
 
-  AllAuthors& all_authors = AllAuthors::GetInstance();
+  PrintSamplerStats(gibbs_state, corpus->getWordTotal(), topic_time);
 
-  for (int i = 0; i < all_authors.getAuthors(); i++) {
-    Author* author = all_authors.getMutableAuthor(i);
-    AuthorUtils::SampleTopics(author,
-                              permute,
-                              true,
-                              alpha,
-                              all_topics, inf);
-  }
-
-  // Sample hyper-parameters.
+  // Optimize hyper-parameters.
   if (gibbs_state->getHyperLag() > 0 &&
       (current_iteration % gibbs_state->getHyperLag() == 0)) {
-   
-    if (gibbs_state->getSampleAlpha() == 1) {
-    	// TODO
-    }
-    if (gibbs_state->getSampleEta() == 1) {
-    	// TODO
-    }
+    OptimizeHyperParameters(gibbs_state, inf);
   }
 
   // Compute the Gibbs score with the new parameter values.
@@ -387,18 +824,128 @@ void GibbsSampler::IterateGibbsState(GibbsState* gibbs_state, bool inf) {
        << gibbs_state->getIteration() << " = " << gibbs_score << endl;
 }
 
+void GibbsSampler::OptimizeHyperParameters(GibbsState* gibbs_state,
+                                           bool inf) {
+  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
+  int topic_no = all_topics->getTopics();
+  assert(topic_no > 0);
+
+  if (gibbs_state->getSampleAlpha() == 1 ||
+      gibbs_state->getSampleAlpha() == 2) {
+    vector<vector<int>> topic_hists;
+    vector<int> length_hist;
+    HyperOptimizer::AuthorHistograms(
+        gibbs_state->getMutableContext()->getMutableAllAuthors(), topic_no,
+        &topic_hists, &length_hist);
+
+    if (gibbs_state->getSampleAlpha() == 2) {
+      vector<double> topic_alphas = *gibbs_state->getTopicAlphas();
+      HyperOptimizer::OptimizeAsymmetric(topic_hists, length_hist,
+                                         &topic_alphas);
+      gibbs_state->setTopicAlphas(topic_alphas);
+    } else {
+      // A symmetric alpha pools the counts of all the topics.
+      vector<int> count_hist;
+      for (auto& topic_hist : topic_hists) {
+        if (count_hist.size() < topic_hist.size()) {
+          count_hist.resize(topic_hist.size(), 0);
+        }
+        for (size_t n = 0; n < topic_hist.size(); n++) {
+          count_hist[n] += topic_hist[n];
+        }
+      }
+      gibbs_state->setAlpha(HyperOptimizer::OptimizeSymmetric(
+          count_hist, length_hist, gibbs_state->getAlpha(), topic_no));
+    }
+    cout << "Alpha at iteration " << gibbs_state->getIteration()
+         << " = " << gibbs_state->getAlpha() << endl;
+  }
+
+  if (gibbs_state->getSampleEta() == 1 && !inf) {
+    vector<int> count_hist;
+    vector<int> length_hist;
+    HyperOptimizer::TopicWordHistograms(all_topics, &count_hist,
+                                        &length_hist);
+    Topic* topic = all_topics->getMutableTopic(0);
+    double eta = HyperOptimizer::OptimizeSymmetric(
+        count_hist, length_hist, topic->getEta(), topic->getCorpusWordNo());
+    for (int i = 0; i < topic_no; i++) {
+      all_topics->getMutableTopic(i)->setEta(eta);
+    }
+    cout << "Eta at iteration " << gibbs_state->getIteration()
+         << " = " << eta << endl;
+  }
+}
+
+void GibbsSampler::PruneTopics(GibbsState* gibbs_state) {
+  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
+  TopicPruner* topic_pruner = gibbs_state->getMutableTopicPruner();
+  if (!topic_pruner->update(all_topics)) return;
+
+  const vector<int>& topic_map = topic_pruner->getTopicMap();
+  int topic_no = topic_pruner->getTopics();
+  int old_topic_no = all_topics->getTopics();
+
+  ModelContext* context = gibbs_state->getMutableContext();
+  context->getMutableAllWords()->compactTopics(topic_map);
+  AllAuthors* all_authors = context->getMutableAllAuthors();
+  for (int i = 0; i < all_authors->getAuthors(); i++) {
+    all_authors->getMutableAuthor(i)->compactTopics(topic_map, topic_no);
+  }
+  all_topics->compactTopics(topic_map);
+
+  const vector<double>* topic_alphas = gibbs_state->getTopicAlphas();
+  if (topic_alphas != nullptr) {
+    vector<double> kept_alphas(topic_no);
+    for (int i = 0; i < old_topic_no; i++) {
+      if (topic_map[i] != -1) {
+        kept_alphas[topic_map[i]] = (*topic_alphas)[i];
+      }
+    }
+    gibbs_state->setTopicAlphas(kept_alphas);
+  }
+  gibbs_state->getMutableAliasSampler()->clearTables();
+  topic_pruner->compact();
+
+  cout << "Pruned " << old_topic_no - topic_no << " dead topics at iteration "
+       << gibbs_state->getIteration() << ", " << topic_no << " topics left"
+       << endl;
+}
+
 void GibbsSampler::InferATM(
           const string& filename_corpus,
           const string& filename_authors,
           const string& filename_topics,
           const string& filename_other,
           const string& filename_author_counts,
-          long random_seed) {
-  Utils::InitRandomNumberGen(random_seed);
-
+          long random_seed,
+          const string& filename_settings) {
   GibbsState* gibbs_state = new GibbsState();
+  ModelContext* context = gibbs_state->getMutableContext();
+  context->getMutableRandom()->seed(random_seed);
+
+  // Only the convergence settings and the topic layout apply to
+  // inference. The layout is set before the topics are loaded.
+  if (!filename_settings.empty()) {
+    ifstream infile(filename_settings.c_str());
+    char buf[BUF_SIZE];
+    while (infile.getline(buf, BUF_SIZE)) {
+      istringstream s_line(buf);
+      std::string str;
+      getline(s_line, str, ' ');
+      std::string value;
+      getline(s_line, value, ' ');
+      if (str.compare("TOPIC_LAYOUT") == 0) {
+        gibbs_state->getMutableAllTopics()->setLayout(ReadTopicLayout(value));
+      } else {
+        ReadConvergenceSetting(gibbs_state, str, value);
+      }
+    }
+    infile.close();
+  }
 
-  LoadState(gibbs_state, filename_topics, filename_other);
+  vector<int> word_map;
+  LoadState(gibbs_state, filename_topics, filename_other, &word_map);
 
   AllTopics* all_topics = gibbs_state->getMutableAllTopics();
   int topic_no = all_topics->getTopics();
@@ -406,43 +953,52 @@ void GibbsSampler::InferATM(
   bool inf = true;
 
   Corpus* corpus = gibbs_state->getMutableCorpus();
-  CorpusUtils::ReadCorpus(filename_corpus, filename_authors, corpus, topic_no);
-
-  AllAuthorsUtils::LoadAuthors(filename_author_counts);
-
-  for (int i = 0; i < corpus->getDocuments(); i++) {
-    Document* document = corpus->getMutableDocument(i);
-    DocumentUtils::SampleAuthors(document, all_topics, inf);
+  if (word_map.empty()) {
+    CorpusUtils::ReadCorpus(filename_corpus, filename_authors, corpus,
+                            context, topic_no);
+  } else {
+    // The model was trained on relabeled word ids, the test corpus is
+    // read with the same ids.
+    int original_word_no = 0;
+    for (int word_id : word_map) {
+      original_word_no = max(original_word_no, word_id + 1);
+    }
+    vector<int> word_ids(original_word_no, -1);
+    for (size_t i = 0; i < word_map.size(); i++) {
+      word_ids[word_map[i]] = i;
+    }
+    CorpusUtils::ReadCorpus(filename_corpus, filename_authors, corpus,
+                            context, topic_no, GROUP_NONE, &word_ids);
   }
 
-  AllAuthors& all_authors = AllAuthors::GetInstance();
+  AllAuthorsUtils::LoadAuthors(context->getMutableAllAuthors(),
+                               filename_author_counts);
 
-  for (int i = 0; i < all_authors.getAuthors(); i++) {
-    Author* author = all_authors.getMutableAuthor(i);
-
-
-    // Sample topics for this author, without permuting the words
-    // in the author and without removing words from topics.
-    AuthorUtils::SampleTopics(author,
-                                0,
-                                false,
-                                alpha,
-                                all_topics,
-                                inf);
-  }
+  // Sample authors and topics, without permuting the words
+  // and without removing words from topics.
+  SampleAuthorsAndTopics(gibbs_state, corpus->getDocuments(), 0, false, inf);
 
   char filename[1000];
   sprintf(filename, "result/inf-perplexity-%d.dat", topic_no);
   ofstream ofs(filename);
   ofs.precision(12);
+  ConvergenceMonitor* monitor = gibbs_state->getMutableConvergenceMonitor();
   for (int i = 0; i < MAX_ITER_INF; i++) {
     IterateGibbsState(gibbs_state, inf);
-    double perplexity = CorpusUtils::ComputePerplexity(corpus, all_topics, alpha);
+    double perplexity = CorpusUtils::ComputePerplexity(
+        corpus, context, alpha, gibbs_state->getTopicAlphas());
     ofs << perplexity << endl;
+    if (monitor->update(perplexity)) {
+      PrintConvergence(gibbs_state, "perplexity");
+      break;
+    }
   }
 
   ofs.close();
 
+  AllAuthorsUtils::SaveAuthors(context->getMutableAllAuthors(),
+                               "result/inf-author-counts-final.dat");
+
   delete gibbs_state;
 }
 
@@ -456,25 +1012,50 @@ void GibbsSampler::SaveState(
   int topic_no = all_topics->getTopics();
   assert(topic_no > 0);
   double eta = all_topics->getMutableTopic(0)->getEta();
-  int term_no = corpus->getWordNo();
+  // The topics are saved with the ids of the corpus file, with the map
+  // to them if the word ids were relabeled.
+  int term_no = corpus->getOriginalWordNo();
   double alpha = gibbs_state->getAlpha();
+  const vector<int>& word_map = corpus->getWordMap();
 
   ofstream ofs(filename_other);
   ofs << "topic_no " << topic_no << endl;
   ofs << "term_no " << term_no << endl;
+  if (!word_map.empty()) {
+    ofs << "word_map " << WORD_MAP_FILENAME << endl;
+  }
   ofs << "eta " << eta << endl;
   ofs << "alpha " << alpha << endl;
+  const vector<double>* topic_alphas = gibbs_state->getTopicAlphas();
+  if (topic_alphas != nullptr) {
+    ofs << "topic_alphas";
+    for (double topic_alpha : *topic_alphas) {
+      ofs << " " << topic_alpha;
+    }
+    ofs << endl;
+  }
   ofs.close();
 
+  if (!word_map.empty()) {
+    ofstream ofs_map(WORD_MAP_FILENAME);
+    for (int word_id : word_map) {
+      ofs_map << word_id << endl;
+    }
+    ofs_map.close();
+  }
+
   AllTopicsUtils::SaveTopics(all_topics, 
                             filename_topics,
-                            filename_topics_count);
+                            filename_topics_count,
+                            word_map.empty() ? nullptr : &word_map,
+                            term_no);
 }
 
 void GibbsSampler::LoadState(
           GibbsState* gibbs_state,
           const string& filename_topics,
-          const string& filename_other) {
+          const string& filename_other,
+          vector<int>* word_map) {
   AllTopics* all_topics = gibbs_state->getMutableAllTopics();
   ifstream ifs(filename_other);
  
@@ -483,6 +1064,8 @@ void GibbsSampler::LoadState(
   int term_no = 0;
   double eta = 0;
   double alpha = 0.0;
+  vector<double> topic_alphas;
+  string filename_word_map;
 
   while(ifs.getline(buf, BUF_SIZE)) {
     istringstream iss(buf);
@@ -499,14 +1082,24 @@ void GibbsSampler::LoadState(
       eta = atof(value.c_str());
     } else if (str.compare("alpha") == 0) {
       alpha = atof(value.c_str());
+    } else if (str.compare("word_map") == 0) {
+      filename_word_map = value;
+    } else if (str.compare("topic_alphas") == 0) {
+      topic_alphas.push_back(atof(value.c_str()));
+      while (getline(iss, value, ' ')) {
+        topic_alphas.push_back(atof(value.c_str()));
+      }
     }
   }
   ifs.close();
 
   gibbs_state->setAlpha(alpha);
+  gibbs_state->setTopicAlphas(topic_alphas);
 
   assert(topic_no > 0);
   assert(term_no > 0);
+  assert(topic_alphas.empty() ||
+         static_cast<int>(topic_alphas.size()) == topic_no);
 
   cout << "loading " << filename_other << " successfully." << endl;
   cout << "topic_no : " << topic_no << endl;
@@ -514,22 +1107,56 @@ void GibbsSampler::LoadState(
   cout << "eta : " << eta << endl;
   cout << "alpha : " << alpha << endl;
 
+  word_map->clear();
+  if (!filename_word_map.empty()) {
+    ifstream ifs_map(filename_word_map);
+    int word_id;
+    while (ifs_map >> word_id) {
+      word_map->push_back(word_id);
+    }
+    ifs_map.close();
+    assert(!word_map->empty());
+    cout << "word_map : " << filename_word_map << endl;
+  }
+
+  // The model id of each id of the saved topics, -1 for the ids that
+  // are not in the vocabulary of a relabeled model.
+  int word_no = term_no;
+  vector<int> word_ids;
+  if (!word_map->empty()) {
+    word_no = word_map->size();
+    word_ids.assign(term_no, -1);
+    for (int w = 0; w < word_no; w++) {
+      assert((*word_map)[w] >= 0 && (*word_map)[w] < term_no);
+      word_ids[(*word_map)[w]] = w;
+    }
+  }
+
+  // A line has term_no counts, longer than BUF_SIZE for large
+  // vocabularies.
   ifs = ifstream(filename_topics);
+  all_topics->reserveTopics(topic_no);
   for (int i = 0; i < topic_no; i++) {
-    all_topics->addTopic(term_no, eta);
+    all_topics->addTopic(word_no, eta);
     Topic* topic = all_topics->getMutableTopic(i);
 
-    ifs.getline(buf, BUF_SIZE);
-    istringstream iss(buf);
+    string line;
+    getline(ifs, line);
+    istringstream iss(line);
 		
-		int topic_word_no = 0;
+		TokenIndex topic_word_no = 0;
 
+    // The counts start at zero, only the nonzero ones are set.
     for (int w = 0; w < term_no; w++) {
       string str;
       getline(iss, str, ' ');
 			int word_count = atoi(str.c_str());
 			assert(word_count >= 0);
-      topic->setWordCount(w, word_count);
+			if (word_count != 0) {
+				int word_id = word_ids.empty() ? w : word_ids[w];
+				assert(word_id != -1);
+				topic->setWordCount(word_id, word_count);
+			}
 			topic_word_no += word_count;
     }
 		
@@ -542,6 +1169,8 @@ void GibbsSampler::LoadState(
 	}
 
   ifs.close();
+
+  all_topics->indexWordTopics();
 }
 
 }  // namespace atm
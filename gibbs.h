@@ -6,12 +6,62 @@
 #include "topic.h"
 #include "utils.h"
 #include "corpus.h"
+#include "alias_sampler.h"
+#include "convergence_monitor.h"
+#include "cvb0.h"
+#include "ftree_sampler.h"
+#include "hyper_optimizer.h"
+#include "joint_sampler.h"
+#include "linear_sampler.h"
+#include "model_context.h"
+#include "online.h"
+#include "sparse_sampler.h"
+#include "sweep_scheduler.h"
+#include "topic_pruner.h"
 
 namespace atm {
 
+// Topic samplers, selected with the SAMPLER setting.
+enum SamplerType {
+  // "linear" - LinearSampler, O(topics) per word in linear space with SIMD.
+  SAMPLER_LINEAR,
+  // "dense" - AuthorUtils::SampleTopics, O(topics) per word in log space,
+  // the reference for validating the other samplers.
+  SAMPLER_DENSE,
+  // "sparse" - SparseSampler, O(nonzero topics) per word.
+  SAMPLER_SPARSE,
+  // "alias" - AliasSampler, O(MH_STEPS) amortized per word.
+  SAMPLER_ALIAS,
+  // "ftree" - FTreeSampler, O(nonzero topics of the word + log topics).
+  SAMPLER_FTREE,
+  // "joint" - JointSampler, samples the author and the topic of a word
+  // together instead of the separate author and topic phases.
+  SAMPLER_JOINT
+};
+
+// Training engines, selected with the ENGINE setting.
+enum EngineType {
+  // "gibbs" - collapsed Gibbs sampling with the selected topic sampler.
+  ENGINE_GIBBS,
+  // "cvb0" - CVB0, deterministic collapsed variational updates.
+  ENGINE_CVB0,
+  // "online" - OnlineATM, streams the corpus in minibatches.
+  ENGINE_ONLINE
+};
+
+// Order of the words in a sweep, selected with the SWEEP_ORDER setting.
+enum SweepOrder {
+  // "shuffled" - the words are permuted every SHUFFLE_LAG iterations.
+  SWEEP_SHUFFLED,
+  // "sorted" - the words of each author are visited by word id, so that
+  // consecutive words read neighbouring topic word counts.
+  SWEEP_SORTED
+};
+
 // The Gibbs state of the HLDA implementation.
-// Each Gibbs state has a corpus and all topics, and
-// keeps current scores, the current iteration and
+// Each Gibbs state has a corpus and a model context with the words,
+// the authors, the topics and the random number generator of its
+// model, and keeps current scores, the current iteration and
 // the sampling parameters.
 class GibbsState {
  public:
@@ -36,8 +86,8 @@ class GibbsState {
 
   void setSampleEta(int sample_eta) { sample_eta_ = sample_eta; }
   void setSampleAlpha(int sample_alpha) { sample_alpha_ = sample_alpha; }
+  void setHyperLag(int hyper_lag) { hyper_lag_ = hyper_lag; }
   
-  void setCorpus(const Corpus& corpus) { corpus_ = corpus; }
   Corpus* getMutableCorpus() { return &corpus_; }
 
   int getIteration() const { return iteration_; }
@@ -51,15 +101,65 @@ class GibbsState {
   int getSampleAlpha() const { return sample_alpha_; }
   
 
-  void setAllTopics(const AllTopics& all_topics) { all_topics_ = all_topics; }
-  AllTopics* getMutableAllTopics() { return &all_topics_; }
+  ModelContext* getMutableContext() { return &context_; }
+  AllTopics* getMutableAllTopics() { return context_.getMutableAllTopics(); }
 
   void setAlpha(double alpha) { alpha_ = alpha; }
   double getAlpha() const { return alpha_; }
+
+  // Asymmetric alpha, one per topic, used instead of alpha by the linear
+  // sampler and the scores. alpha is set to their mean.
+  void setTopicAlphas(const vector<double>& topic_alphas);
+  // The topic alphas, or nullptr for a symmetric alpha.
+  const vector<double>* getTopicAlphas() const {
+    return topic_alphas_.empty() ? nullptr : &topic_alphas_;
+  }
+
+  void setSampler(SamplerType sampler) { sampler_ = sampler; }
+  SamplerType getSampler() const { return sampler_; }
+  SparseSampler* getMutableSparseSampler() { return &sparse_sampler_; }
+  AliasSampler* getMutableAliasSampler() { return &alias_sampler_; }
+  FTreeSampler* getMutableFTreeSampler() { return &ftree_sampler_; }
+  LinearSampler* getMutableLinearSampler() { return &linear_sampler_; }
+  JointSampler* getMutableJointSampler() { return &joint_sampler_; }
+
+  void setSweepOrder(SweepOrder sweep_order) { sweep_order_ = sweep_order; }
+  SweepOrder getSweepOrder() const { return sweep_order_; }
+  void setSweepTile(int sweep_tile) { sweep_tile_ = sweep_tile; }
+  int getSweepTile() const { return sweep_tile_; }
+
+  void setSelectiveSweeps(int selective_sweeps) {
+    selective_sweeps_ = selective_sweeps;
+  }
+  int getSelectiveSweeps() const { return selective_sweeps_; }
+  SweepScheduler* getMutableSweepScheduler() { return &sweep_scheduler_; }
+
+  void setEngine(EngineType engine) { engine_ = engine; }
+  EngineType getEngine() const { return engine_; }
+  CVB0* getMutableCVB0() { return &cvb0_; }
+  OnlineATM* getMutableOnlineATM() { return &online_atm_; }
+
+  ConvergenceMonitor* getMutableConvergenceMonitor() {
+    return &convergence_monitor_;
+  }
+
+  void setPruneTopics(int prune_topics) { prune_topics_ = prune_topics; }
+  int getPruneTopics() const { return prune_topics_; }
+  TopicPruner* getMutableTopicPruner() { return &topic_pruner_; }
+
+  void setAuthorTime(double author_time) { author_time_ = author_time; }
+  double getAuthorTime() const { return author_time_; }
+
+  // Heap allocations of the last sweep, counted with make ALLOC_COUNT=1.
+  void setSweepAllocations(long sweep_allocations) {
+    sweep_allocations_ = sweep_allocations;
+  }
+  long getSweepAllocations() const { return sweep_allocations_; }
  private:
   Corpus corpus_;
-  AllTopics all_topics_;
+  ModelContext context_;
   double alpha_;
+  vector<double> topic_alphas_;
 
   // The current score obtained by summing the Eta, Gamma and
   // alpha scores.
@@ -79,11 +179,50 @@ class GibbsState {
   int iteration_;
 
   // Sampling parameters.
+  // The hyperparameters are optimized every hyper_lag_ iterations,
+  // alpha if sample_alpha_ is 1 (symmetric) or 2 (one per topic) and
+  // eta if sample_eta_ is 1.
   int shuffle_lag_;
   int hyper_lag_;
   int sample_eta_;
   int sample_alpha_;
 
+  // Topic sampler.
+  SamplerType sampler_;
+  SparseSampler sparse_sampler_;
+  AliasSampler alias_sampler_;
+  FTreeSampler ftree_sampler_;
+  LinearSampler linear_sampler_;
+  JointSampler joint_sampler_;
+
+  // Order of the words in a sweep.
+  SweepOrder sweep_order_;
+
+  // Word ids per vocabulary tile of a sorted sweep, 0 for no tiling.
+  int sweep_tile_;
+
+  // Selective sweeps, 1 to skip words whose topic has stabilized.
+  int selective_sweeps_;
+  SweepScheduler sweep_scheduler_;
+
+  // Training engine.
+  EngineType engine_;
+  CVB0 cvb0_;
+  OnlineATM online_atm_;
+
+  // Early stopping on the Gibbs score in training and on the perplexity
+  // in inference.
+  ConvergenceMonitor convergence_monitor_;
+
+  // Dead topic pruning, 1 to remove the topics the pruner finds dead.
+  int prune_topics_;
+  TopicPruner topic_pruner_;
+
+  // Time of the last author phase in seconds.
+  double author_time_;
+
+  // Heap allocations of the last sweep.
+  long sweep_allocations_;
 };
 
 // This class provides functionality for reading input for the
@@ -108,25 +247,95 @@ class GibbsSampler {
   // Initialize Gibbs state - repeat the initialization REP_NO,
   // by calling InitGibbsState.
   // Keep the Gibbs state with the best score.
-  // rng_seed is the random number generator seed.
+  // rng_seed is the random number generator seed, repetition i draws
+  // from stream i of it.
   static GibbsState* InitGibbsStateRep(
       const std::string& filename_corpus,
       const std::string& filename_authors,
       const std::string& filename_settings,
       long rng_seed);
 
+  // Sample the word topics of an author with the sampler
+  // selected in the Gibbs state, in the selected sweep order.
+  static void SampleTopics(GibbsState* gibbs_state,
+                           Author* author,
+                           int permute_words,
+                           bool remove,
+                           bool inf=false);
+
+  // Sample the authors of the words in the first doc_no documents and
+  // the topics of the words, as two phases or with the joint sampler.
+  // Returns the time spent sampling topics in seconds.
+  static double SampleAuthorsAndTopics(GibbsState* gibbs_state,
+                                       int doc_no,
+                                       int permute_words,
+                                       bool remove,
+                                       bool inf=false);
+
+  // Sample the topics of the words of an author selected by the sweep
+  // scheduler with the linear sampler.
+  static void SampleTopicsSelective(GibbsState* gibbs_state,
+                                    Author* author,
+                                    int permute_words,
+                                    bool remove,
+                                    bool inf=false);
+
+  // Sample the topics of all authors with the linear sampler, one
+  // vocabulary tile of SWEEP_TILE word ids at a time across the authors,
+  // so that the topic word counts of a tile stay in cache.
+  static void SampleTopicsTiled(GibbsState* gibbs_state,
+                                bool remove,
+                                bool inf=false);
+
+  // Print statistics of the topic sampler for the current iteration,
+  // topic_time is the time spent sampling the topics of tokens words
+  // in seconds.
+  static void PrintSamplerStats(GibbsState* gibbs_state,
+                                long tokens,
+                                double topic_time);
+
   // Iterations of the Gibbs state.
   // Sample the document path and the word levels in the tree.
-  // Sample hyperparameters: Eta, GEM mean and scale.
+  // Optimize the hyperparameters alpha and eta every HYPER_LAG iterations.
   static void IterateGibbsState(GibbsState* gibbs_state, bool inf=false);
 
+  // Optimize alpha and eta, as selected by SAMPLE_ALPHA and SAMPLE_ETA,
+  // with HyperOptimizer from the current counts. Eta is kept during
+  // inference, the topics are fixed.
+  static void OptimizeHyperParameters(GibbsState* gibbs_state,
+                                      bool inf=false);
+
+  // Remove the dead topics found by the topic pruner from the topics,
+  // the authors, the words and the samplers, renumbering the others.
+  // The words of a removed topic are left without a topic and sampled
+  // again in the next sweep.
+  static void PruneTopics(GibbsState* gibbs_state);
+
+  // Infer the topics of the authors of a corpus with the saved topics,
+  // the settings file (optional) gives the convergence settings.
   static void InferATM(
           const string& filename_corpus,
           const string& filename_authors,
           const string& filename_topics,
-          const string& filename_settings,
+          const string& filename_other,
           const string& filename_author_counts,
-          long rng_seed);
+          long rng_seed,
+          const string& filename_settings="");
+
+  // Read a CONVERGENCE_* setting into the convergence monitor of the
+  // Gibbs state, return false if the key is not one.
+  static bool ReadConvergenceSetting(GibbsState* gibbs_state,
+                                     const string& key,
+                                     const string& value);
+
+  // Parse the value of the TOPIC_LAYOUT setting, "word", "hybrid" or
+  // "topic".
+  static TopicLayout ReadTopicLayout(const string& value);
+
+  // Log that the monitored value (the Gibbs score or the perplexity)
+  // has converged.
+  static void PrintConvergence(GibbsState* gibbs_state,
+                               const string& value_name);
 
   static void SaveState(
           GibbsState* gibbs_state,
@@ -134,13 +343,21 @@ class GibbsSampler {
           const string& filename_topics,
           const string& filename_topics_count);
 
+  // The topics are saved with the ids of the corpus file. word_map is
+  // set to the original id of each word id of the model if it was
+  // trained on relabeled ids, and the topics are loaded over those word
+  // ids; it is emptied otherwise.
   static void LoadState(
           GibbsState* gibbs_state,
           const string& filename_topics,
-          const string& filename_other);
+          const string& filename_other,
+          vector<int>* word_map);
 
+  // Iterate over the first rand_doc_no documents, which hold tokens
+  // words.
   static void IterateGibbsStatePart(GibbsState* gibbs_state,
-                                    int rand_doc_no);
+                                    int rand_doc_no,
+                                    long tokens);
 
   static void TrainByPart(const string& filename_corpus,
                           const string& filename_authors,
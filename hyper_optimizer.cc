@@ -0,0 +1,126 @@
+#include <math.h>
+
+#include "hyper_optimizer.h"
+#include "author.h"
+
+#define MAX_FIXED_POINT_ITER 100
+#define FIXED_POINT_TOLERANCE 1e-6
+#define MIN_VALUE 1e-6
+
+namespace atm {
+
+// =======================================================================
+// HyperOptimizer
+// =======================================================================
+
+void HyperOptimizer::AuthorHistograms(AllAuthors* all_authors,
+                                      int topics,
+                                      vector<vector<int>>* topic_hists,
+                                      vector<int>* length_hist) {
+  topic_hists->assign(topics, vector<int>());
+  length_hist->clear();
+
+  for (int a = 0; a < all_authors->getAuthors(); a++) {
+    Author* author = all_authors->getMutableAuthor(a);
+    int length = 0;
+    for (int i = 0; i < author->getNonzeroTopics(); i++) {
+      int topic_id = author->getNonzeroTopic(i);
+      int count = author->getNonzeroCount(i);
+      vector<int>& hist = (*topic_hists)[topic_id];
+      if (static_cast<int>(hist.size()) <= count) {
+        hist.resize(count + 1, 0);
+      }
+      hist[count]++;
+      length += count;
+    }
+    if (length == 0) continue;
+    if (static_cast<int>(length_hist->size()) <= length) {
+      length_hist->resize(length + 1, 0);
+    }
+    (*length_hist)[length]++;
+  }
+}
+
+void HyperOptimizer::TopicWordHistograms(AllTopics* all_topics,
+                                         vector<int>* count_hist,
+                                         vector<int>* length_hist) {
+  count_hist->clear();
+  length_hist->clear();
+  int topics = all_topics->getTopics();
+  if (topics == 0) return;
+
+  // Only the nonzero counts, through the per-word topic lists.
+  int terms = all_topics->getMutableTopic(0)->getCorpusWordNo();
+  for (int w = 0; w < terms; w++) {
+    int word_topic_no = all_topics->getWordTopics(w).size();
+    for (int i = 0; i < word_topic_no; i++) {
+      int count = all_topics->getWordTopicCount(w, i);
+      if (static_cast<int>(count_hist->size()) <= count) {
+        count_hist->resize(count + 1, 0);
+      }
+      (*count_hist)[count]++;
+    }
+  }
+
+  for (int k = 0; k < topics; k++) {
+    TokenIndex length = all_topics->getMutableTopic(k)->getTopicWordNo();
+    if (length == 0) continue;
+    if (static_cast<TokenIndex>(length_hist->size()) <= length) {
+      length_hist->resize(length + 1, 0);
+    }
+    (*length_hist)[length]++;
+  }
+}
+
+double HyperOptimizer::DigammaSum(const vector<int>& hist, double value) {
+  double sum = 0.0;
+  double digamma_diff = 0.0;
+  for (size_t n = 1; n < hist.size(); n++) {
+    digamma_diff += 1.0 / (value + n - 1);
+    sum += hist[n] * digamma_diff;
+  }
+  return sum;
+}
+
+double HyperOptimizer::OptimizeSymmetric(const vector<int>& count_hist,
+                                         const vector<int>& length_hist,
+                                         double value,
+                                         int dim) {
+  for (int iter = 0; iter < MAX_FIXED_POINT_ITER; iter++) {
+    double numerator = DigammaSum(count_hist, value);
+    double denominator = dim * DigammaSum(length_hist, dim * value);
+    if (numerator <= 0.0 || denominator <= 0.0) break;
+
+    double new_value = fmax(value * numerator / denominator, MIN_VALUE);
+    double change = fabs(new_value - value) / value;
+    value = new_value;
+    if (change < FIXED_POINT_TOLERANCE) break;
+  }
+  return value;
+}
+
+void HyperOptimizer::OptimizeAsymmetric(const vector<vector<int>>& count_hists,
+                                        const vector<int>& length_hist,
+                                        vector<double>* values) {
+  int dim = values->size();
+  for (int iter = 0; iter < MAX_FIXED_POINT_ITER; iter++) {
+    double sum = 0.0;
+    for (int k = 0; k < dim; k++) {
+      sum += (*values)[k];
+    }
+    double denominator = DigammaSum(length_hist, sum);
+    if (denominator <= 0.0) break;
+
+    double change = 0.0;
+    for (int k = 0; k < dim; k++) {
+      double value = (*values)[k];
+      double numerator = DigammaSum(count_hists[k], value);
+      double new_value = fmax(value * numerator / denominator, MIN_VALUE);
+      change = fmax(change, fabs(new_value - value) / value);
+      (*values)[k] = new_value;
+    }
+    if (change < FIXED_POINT_TOLERANCE) break;
+  }
+}
+
+}  // namespace atm
@@ -0,0 +1,58 @@
+#ifndef HYPER_OPTIMIZER_H_
+#define HYPER_OPTIMIZER_H_
+
+#include <vector>
+
+#include "author.h"
+#include "topic.h"
+
+using namespace std;
+
+namespace atm {
+
+// Fixed-point optimization of the Dirichlet hyperparameters (Minka),
+// from histograms of the counts (Wallach).
+// For a Dirichlet with parameters a_k over groups g with counts n_gk and
+// totals n_g, the maximum likelihood fixed point is
+//   a_k <- a_k * sum_g [digamma(n_gk + a_k) - digamma(a_k)] /
+//                sum_g [digamma(n_g + sum_k a_k) - digamma(sum_k a_k)]
+// and digamma(n + a) - digamma(a) = sum_{i < n} 1 / (a + i). With
+// count_hist[n] groups of count n and length_hist[n] groups of total n
+// both sums are a single pass over the histogram, so an iteration costs
+// O(maximum count) whatever the size of the corpus.
+// For alpha the groups are the authors, for eta the topics.
+class HyperOptimizer {
+ public:
+  // Histograms of the author-topic counts: topic_hists[k][n] authors
+  // with n_ak = n, length_hist[n] authors with n_a = n (n > 0).
+  static void AuthorHistograms(AllAuthors* all_authors,
+                               int topics,
+                               vector<vector<int>>* topic_hists,
+                               vector<int>* length_hist);
+
+  // Histograms of the topic-word counts: count_hist[n] (topic, word)
+  // pairs with n_kw = n, length_hist[n] topics with n_k = n (n > 0).
+  static void TopicWordHistograms(AllTopics* all_topics,
+                                  vector<int>* count_hist,
+                                  vector<int>* length_hist);
+
+  // Symmetric parameter value of a Dirichlet of dimension dim, with the
+  // counts of all the dimensions pooled in count_hist.
+  static double OptimizeSymmetric(const vector<int>& count_hist,
+                                  const vector<int>& length_hist,
+                                  double value,
+                                  int dim);
+
+  // Asymmetric parameters, one count histogram per dimension.
+  static void OptimizeAsymmetric(const vector<vector<int>>& count_hists,
+                                 const vector<int>& length_hist,
+                                 vector<double>* values);
+
+ private:
+  // sum_n hist[n] (digamma(n + value) - digamma(value)).
+  static double DigammaSum(const vector<int>& hist, double value);
+};
+
+}  // namespace atm
+
+#endif  // HYPER_OPTIMIZER_H_
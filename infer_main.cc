@@ -7,7 +7,7 @@ using atm::GibbsState;
 
 
 int main(int argc, char** argv) {
-  if (argc == 3) {
+  if (argc == 3 || argc == 4) {
     // The random number generator seed.
     // For testing an example seed is: t = 1147530551;
     long rng_seed = 458312327;
@@ -18,17 +18,17 @@ int main(int argc, char** argv) {
     std::string filename_topics_count = "result/train-topics-counts-final.dat";
     string filename_other = "result/train.other";
     string filename_author_counts = "result/train-author-counts-final.dat";
-    string doc_no = argv[4];
-    
+    string filename_settings = (argc == 4) ? argv[3] : "";
+
     GibbsSampler::InferATM(filename_corpus, filename_authors,
                               filename_topics_count, filename_other,
-                              filename_author_counts, rng_seed);
+                              filename_author_counts, rng_seed,
+                              filename_settings);
   } else {
     cout << "Arguments: "
         "(1) corpus filename "
         "(2) author filename "
-        "(3) settings filename " 
-        "(4) part of train doc number" << endl;
+        "(3) settings filename (optional)" << endl;
   }
   return 0;
 }
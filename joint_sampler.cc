@@ -0,0 +1,231 @@
+#include <algorithm>
+
+#include "joint_sampler.h"
+#include "model_context.h"
+#include "sample_kernel.h"
+#include "utils.h"
+
+namespace atm {
+
+// =======================================================================
+// JointSampler
+// =======================================================================
+
+JointSampler::JointSampler()
+		: alpha_(0.0),
+		  mh_authors_(4),
+		  mh_steps_(1),
+		  proposals_(0),
+		  accepted_(0) {
+}
+
+double JointSampler::getAcceptanceRate() const {
+	if (proposals_ == 0) return 0.0;
+	return static_cast<double>(accepted_) / proposals_;
+}
+
+void JointSampler::initDocument(AllTopics* all_topics) {
+	int topics = all_topics->getTopics();
+	denominators_.resize(topics);
+	for (int i = 0; i < topics; i++) {
+		updateDenominator(i, all_topics);
+	}
+}
+
+void JointSampler::updateDenominator(int topic_id, AllTopics* all_topics) {
+	Topic* topic = all_topics->getMutableTopic(topic_id);
+	denominators_[topic_id] = topic->getEta() * topic->getCorpusWordNo() +
+														topic->getTopicWordNo();
+}
+
+void JointSampler::initWord(int word_id, AllTopics* all_topics) {
+	int topics = all_topics->getTopics();
+	double eta = all_topics->getMutableTopic(0)->getEta();
+	fill(factors_.begin(), factors_.begin() + topics, eta);
+	all_topics->addWordCounts(word_id, factors_.data());
+}
+
+double JointSampler::fillAuthorWeights(Author* author,
+																			 int topics,
+																			 double* weights) {
+	fill(weights, weights + topics, alpha_);
+	author->addTopicCounts(weights);
+	for (int i = 0; i < topics; i++) {
+		weights[i] /= denominators_[i];
+	}
+	return 1.0 / (author->getSumTopicCounts(topics) + topics * alpha_);
+}
+
+void JointSampler::removeWord(Document* document,
+															Word word,
+															ModelContext* context,
+															bool inf) {
+	int author_slot = word.getAuthorSlot();
+	int topic_id = word.getTopicId();
+	if (author_slot == -1 || topic_id == -1) {
+		return;
+	}
+
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Author* author = context->getMutableAllAuthors()->getMutableAuthor(
+			document->getAuthorId(author_slot));
+	AuthorUtils::UpdateTopicFromWord(author, word, -1, all_topics, inf);
+	updateDenominator(topic_id, all_topics);
+}
+
+void JointSampler::addWord(Document* document,
+													 Word word,
+													 TokenIndex word_idx,
+													 int author_slot,
+													 int topic_id,
+													 ModelContext* context,
+													 bool inf) {
+	AllWords* all_words = context->getMutableAllWords();
+	AllAuthors* all_authors = context->getMutableAllAuthors();
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Author* author =
+			all_authors->getMutableAuthor(document->getAuthorId(author_slot));
+
+	int old_author_slot = word.getAuthorSlot();
+	if (old_author_slot != author_slot) {
+		if (old_author_slot != -1) {
+			all_authors->getMutableAuthor(document->getAuthorId(old_author_slot))
+					->removeWord(word_idx, all_words);
+		}
+		author->addWord(word_idx, all_words);
+		word.setAuthorSlot(author_slot);
+	}
+
+	word.setTopicId(topic_id);
+	AuthorUtils::UpdateTopicFromWord(author, word, 1, all_topics, inf);
+	updateDenominator(topic_id, all_topics);
+}
+
+void JointSampler::sampleWord(Document* document,
+															TokenIndex word_idx,
+															ModelContext* context,
+															bool inf) {
+	AllAuthors* all_authors = context->getMutableAllAuthors();
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Word word = context->getMutableAllWords()->getMutableWord(word_idx);
+	removeWord(document, word, context, inf);
+
+	int authors = document->getAuthors();
+	int topics = all_topics->getTopics();
+	initWord(word.getId(), all_topics);
+
+	// One block of topics weights per author, scaled by the author
+	// normalization, all blocks share the word factors.
+	for (int j = 0; j < authors; j++) {
+		Author* author = all_authors->getMutableAuthor(document->getAuthorId(j));
+		double* weights = &weights_[j * topics];
+		double norm = fillAuthorWeights(author, topics, weights);
+		for (int i = 0; i < topics; i++) {
+			weights[i] *= norm;
+		}
+		if (j > 0) {
+			copy(factors_.begin(), factors_.begin() + topics,
+					 factors_.begin() + j * topics);
+		}
+	}
+
+	double rand_no = context->getMutableRandom()->uniform();
+	int sample = SampleKernel::Sample(weights_.data(),
+																		factors_.data(),
+																		cdf_.data(),
+																		authors * topics,
+																		rand_no);
+
+	addWord(document, word, word_idx, sample / topics, sample % topics,
+					context, inf);
+}
+
+void JointSampler::sampleWordMH(Document* document,
+																TokenIndex word_idx,
+																ModelContext* context,
+																bool inf) {
+	AllAuthors* all_authors = context->getMutableAllAuthors();
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Random* random = context->getMutableRandom();
+	Word word = context->getMutableAllWords()->getMutableWord(word_idx);
+	removeWord(document, word, context, inf);
+
+	int authors = document->getAuthors();
+	int topics = all_topics->getTopics();
+	initWord(word.getId(), all_topics);
+
+	// The proposal picks the author uniformly and the topic from the
+	// conditional given that author, so the acceptance ratio only
+	// depends on the author masses sum_k p(a, k).
+	int author_slot = word.getAuthorSlot();
+	int topic_id = word.getTopicId();
+	double mass = 0.0;
+	if (author_slot != -1 && topic_id != -1) {
+		Author* author =
+				all_authors->getMutableAuthor(document->getAuthorId(author_slot));
+		double norm = fillAuthorWeights(author, topics, weights_.data());
+		for (int i = 0; i < topics; i++) {
+			mass += weights_[i] * factors_[i];
+		}
+		mass *= norm;
+	}
+
+	for (int step = 0; step < mh_steps_; step++) {
+		int new_author_slot = random->uniformInt(authors);
+		Author* author =
+				all_authors->getMutableAuthor(document->getAuthorId(new_author_slot));
+		double norm = fillAuthorWeights(author, topics, weights_.data());
+		int new_topic_id = SampleKernel::Sample(weights_.data(),
+																						factors_.data(),
+																						cdf_.data(),
+																						topics,
+																						random->uniform());
+		double new_mass = norm * cdf_[topics - 1];
+
+		// Without a current assignment, the first proposal is taken.
+		proposals_++;
+		if (mass == 0.0 || random->uniform() * mass < new_mass) {
+			author_slot = new_author_slot;
+			topic_id = new_topic_id;
+			mass = new_mass;
+			accepted_++;
+		}
+	}
+
+	addWord(document, word, word_idx, author_slot, topic_id, context, inf);
+}
+
+void JointSampler::sampleDocument(Document* document,
+																	int permute_words,
+																	double alpha,
+																	ModelContext* context,
+																	bool inf) {
+	int word_no = document->getWords();
+	if (word_no == 0) return;
+
+	// Permute the words in the document.
+	if (permute_words == 1) {
+		DocumentUtils::PermuteWords(document, context);
+	}
+
+	AllTopics* all_topics = context->getMutableAllTopics();
+	alpha_ = alpha;
+	initDocument(all_topics);
+
+	int authors = document->getAuthors();
+	int size = authors * all_topics->getTopics();
+	weights_.resize(size);
+	factors_.resize(size);
+	cdf_.resize(size);
+
+	for (int i = 0; i < word_no; i++) {
+		TokenIndex word_idx = document->getWord(i);
+		if (authors > mh_authors_) {
+			sampleWordMH(document, word_idx, context, inf);
+		} else {
+			sampleWord(document, word_idx, context, inf);
+		}
+	}
+}
+
+}  // namespace atm
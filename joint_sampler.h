@@ -0,0 +1,101 @@
+#ifndef JOINT_SAMPLER_H_
+#define JOINT_SAMPLER_H_
+
+#include <vector>
+
+#include "author.h"
+#include "document.h"
+#include "topic.h"
+
+using namespace std;
+
+namespace atm {
+
+// Blocked sampler drawing the author and the topic of a word together
+// from the collapsed author-topic conditional over the authors of the
+// document and all topics:
+//   p(a, k) ~ (n_ak + alpha) / (n_a + K alpha) *
+//             (n_kw + eta) / (n_k + V eta).
+// This replaces the uniform DocumentUtils::SampleAuthors phase followed
+// by the AuthorUtils::SampleTopics phase, which restarts the topic of
+// every word that changes author.
+// Documents with up to mh_authors authors are sampled exactly in
+// O(authors * topics) per word. Documents with more authors use an
+// independence Metropolis-Hastings step that proposes a uniform author
+// and a topic from its conditional, costing O(topics) per proposal.
+class JointSampler {
+public:
+	JointSampler();
+
+	// Sample the author and topic of every word in the document.
+	// The words are permuted first if permute_words is 1.
+	void sampleDocument(Document* document,
+											int permute_words,
+											double alpha,
+											ModelContext* context,
+											bool inf=false);
+
+	// Documents with more authors than this use the MH step.
+	void setMHAuthors(int mh_authors) { mh_authors_ = mh_authors; }
+	int getMHAuthors() const { return mh_authors_; }
+
+	// Number of proposals per word in the MH step.
+	void setMHSteps(int mh_steps) { mh_steps_ = mh_steps; }
+	int getMHSteps() const { return mh_steps_; }
+
+	// Fraction of MH proposals accepted since the last reset.
+	double getAcceptanceRate() const;
+	long getProposals() const { return proposals_; }
+	void resetAcceptanceRate() { proposals_ = 0; accepted_ = 0; }
+
+private:
+	// Compute the topic denominators n_k + V eta.
+	void initDocument(AllTopics* all_topics);
+
+	// Fill factors_ with n_kw + eta for the word.
+	void initWord(int word_id, AllTopics* all_topics);
+
+	// Fill weights (topics entries) with (n_ak + alpha) / (n_k + V eta)
+	// and return 1 / (n_a + K alpha).
+	double fillAuthorWeights(Author* author, int topics, double* weights);
+
+	void sampleWord(Document* document, TokenIndex word_idx,
+									ModelContext* context, bool inf);
+	void sampleWordMH(Document* document, TokenIndex word_idx,
+										ModelContext* context, bool inf);
+
+	// Remove the word from the counts of its author and topic,
+	// the word keeps its author slot and topic id.
+	void removeWord(Document* document, Word word, ModelContext* context,
+									bool inf);
+
+	// Assign the word to the author in the slot of the document and to
+	// the topic, and add it to the counts.
+	void addWord(Document* document, Word word, TokenIndex word_idx,
+							 int author_slot, int topic_id,
+							 ModelContext* context, bool inf);
+
+	// Recompute the denominator of the topic after a count change.
+	void updateDenominator(int topic_id, AllTopics* all_topics);
+
+	double alpha_;
+	int mh_authors_;
+	int mh_steps_;
+
+	// n_k + V eta for each topic.
+	vector<double> denominators_;
+
+	// Kernel weights, factors and cumulative sums,
+	// authors * topics entries.
+	vector<double> weights_;
+	vector<double> factors_;
+	vector<double> cdf_;
+
+	// Acceptance statistics of the MH step.
+	long proposals_;
+	long accepted_;
+};
+
+}  // namespace atm
+
+#endif  // JOINT_SAMPLER_H_
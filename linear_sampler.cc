@@ -0,0 +1,194 @@
+#include <assert.h>
+
+#include <algorithm>
+
+#include "linear_sampler.h"
+#include "model_context.h"
+#include "sample_kernel.h"
+#include "utils.h"
+
+namespace atm {
+
+// =======================================================================
+// LinearSampler
+// =======================================================================
+
+LinearSampler::LinearSampler() {
+}
+
+void LinearSampler::initAuthor(Author* author,
+															 double alpha,
+															 AllTopics* all_topics) {
+	int topics = all_topics->getTopics();
+	if (topic_alphas_.empty()) {
+		alphas_.assign(topics, alpha);
+	} else {
+		assert(static_cast<int>(topic_alphas_.size()) == topics);
+		alphas_ = topic_alphas_;
+	}
+	author_weights_.resize(topics);
+	word_factors_.resize(topics);
+	cdf_.resize(topics);
+
+	copy(alphas_.begin(), alphas_.end(), author_weights_.begin());
+	author->addTopicCounts(author_weights_.data());
+	for (int i = 0; i < topics; i++) {
+		Topic* topic = all_topics->getMutableTopic(i);
+		author_weights_[i] /=
+				topic->getEta() * topic->getCorpusWordNo() + topic->getTopicWordNo();
+	}
+}
+
+void LinearSampler::updateTopic(Author* author,
+																Word word,
+																int update,
+																AllTopics* all_topics,
+																bool inf) {
+	int topic_id = word.getTopicId();
+	if (topic_id == -1) {
+		return;
+	}
+
+	AuthorUtils::UpdateTopicFromWord(author, word, update, all_topics, inf);
+	updateAuthorWeight(author, topic_id, all_topics);
+}
+
+void LinearSampler::updateUnit(Author* author,
+															 int word_id,
+															 int topic_id,
+															 int update,
+															 AllTopics* all_topics,
+															 bool inf) {
+	author->updateTopicCounts(topic_id, update);
+	if (not inf) {
+		all_topics->updateWordCount(topic_id, word_id, update);
+		word_factors_[topic_id] += update;
+	}
+	updateAuthorWeight(author, topic_id, all_topics);
+}
+
+void LinearSampler::updateAuthorWeight(Author* author,
+																			 int topic_id,
+																			 AllTopics* all_topics) {
+	Topic* topic = all_topics->getMutableTopic(topic_id);
+	author_weights_[topic_id] =
+			(author->getTopicCounts(topic_id) + alphas_[topic_id]) /
+			(topic->getEta() * topic->getCorpusWordNo() + topic->getTopicWordNo());
+}
+
+void LinearSampler::initWord(int word_id, AllTopics* all_topics) {
+	int topics = all_topics->getTopics();
+	double eta = all_topics->getMutableTopic(0)->getEta();
+	fill(word_factors_.begin(), word_factors_.begin() + topics, eta);
+	all_topics->addWordCounts(word_id, word_factors_.data());
+}
+
+void LinearSampler::sampleTopic(Author* author,
+																TokenIndex word_idx,
+																bool remove,
+																ModelContext* context,
+																bool inf) {
+	Word word = context->getMutableAllWords()->getMutableWord(word_idx);
+	if (word.getCount() > 1) {
+		sampleGroup(author, word_idx, remove, context, inf);
+		return;
+	}
+
+	AllTopics* all_topics = context->getMutableAllTopics();
+
+	if (remove) {
+		updateTopic(author, word, -1, all_topics, inf);
+	}
+
+	int topics = all_topics->getTopics();
+	initWord(word.getId(), all_topics);
+
+	double rand_no = context->getMutableRandom()->uniform();
+	int sample_topic_id = SampleKernel::Sample(author_weights_.data(),
+																						 word_factors_.data(),
+																						 cdf_.data(),
+																						 topics,
+																						 rand_no);
+
+	word.setTopicId(sample_topic_id);
+	updateTopic(author, word, 1, all_topics, inf);
+}
+
+void LinearSampler::sampleGroup(Author* author,
+																TokenIndex word_idx,
+																bool remove,
+																ModelContext* context,
+																bool inf) {
+	AllWords* all_words = context->getMutableAllWords();
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Random* random = context->getMutableRandom();
+	Word word = all_words->getMutableWord(word_idx);
+	int* unit_topics = all_words->getMutableUnitTopics(word_idx);
+	int word_id = word.getId();
+	int topics = all_topics->getTopics();
+
+	// Every occurrence is removed before its draw, so each draw is from
+	// the exact conditional given all the other occurrences.
+	initWord(word_id, all_topics);
+	for (int i = 0; i < word.getCount(); i++) {
+		if (remove && unit_topics[i] != -1) {
+			updateUnit(author, word_id, unit_topics[i], -1, all_topics, inf);
+		}
+
+		unit_topics[i] = SampleKernel::Sample(author_weights_.data(),
+																					word_factors_.data(),
+																					cdf_.data(),
+																					topics,
+																					random->uniform());
+		updateUnit(author, word_id, unit_topics[i], 1, all_topics, inf);
+	}
+}
+
+void LinearSampler::sampleTopics(Author* author,
+																 int permute_words,
+																 bool remove,
+																 double alpha,
+																 ModelContext* context,
+																 bool inf) {
+	int author_word_count = author->getWords();
+	if (author_word_count == 0) return;
+
+	// Permute the words in the author.
+	if (permute_words == 1) {
+		AuthorUtils::PermuteWords(author, context);
+	}
+
+	sampleTopicRange(author, 0, author_word_count, remove, alpha, context,
+									 inf);
+}
+
+void LinearSampler::sampleTopicRange(Author* author,
+																		 int begin,
+																		 int end,
+																		 bool remove,
+																		 double alpha,
+																		 ModelContext* context,
+																		 bool inf) {
+	initAuthor(author, alpha, context->getMutableAllTopics());
+
+	for (int i = begin; i < end; i++) {
+		TokenIndex word_idx = author->getWord(i);
+		sampleTopic(author, word_idx, remove, context, inf);
+	}
+}
+
+void LinearSampler::sampleTopicList(Author* author,
+																		const vector<TokenIndex>& word_idxs,
+																		bool remove,
+																		double alpha,
+																		ModelContext* context,
+																		bool inf) {
+	if (word_idxs.empty()) return;
+	initAuthor(author, alpha, context->getMutableAllTopics());
+
+	for (TokenIndex word_idx : word_idxs) {
+		sampleTopic(author, word_idx, remove, context, inf);
+	}
+}
+
+}  // namespace atm
@@ -0,0 +1,117 @@
+#ifndef LINEAR_SAMPLER_H_
+#define LINEAR_SAMPLER_H_
+
+#include <vector>
+
+#include "author.h"
+#include "topic.h"
+
+using namespace std;
+
+namespace atm {
+
+// Dense topic sampler in linear space.
+// The conditional (n_ak + alpha) (n_kw + eta) / (n_k + V eta) is the
+// product of an author weight (n_ak + alpha) / (n_k + V eta), cached for
+// every topic and updated on each count change, and a word factor
+// n_kw + eta gathered for the word. SampleKernel multiplies them and
+// draws the topic with SIMD, without any log or exp.
+// Draws from the same distribution as AuthorUtils::SampleTopics.
+// Word groups (see Word) gather the word factors once and draw their
+// occurrences one after the other, updating the author weight and the
+// word factor of the changed topics only.
+// Also samples with an asymmetric alpha, one per topic (setTopicAlphas).
+class LinearSampler {
+public:
+	LinearSampler();
+
+	// Sample the word topics for a given author,
+	// with the same arguments as AuthorUtils::SampleTopics.
+	void sampleTopics(Author* author,
+										int permute_words,
+										bool remove,
+										double alpha,
+										ModelContext* context,
+										bool inf=false);
+
+	// Sample the topics of the words begin to end - 1 of the author,
+	// without permuting the words.
+	void sampleTopicRange(Author* author,
+												int begin,
+												int end,
+												bool remove,
+												double alpha,
+												ModelContext* context,
+												bool inf=false);
+
+	// One alpha per topic replacing the alpha argument of the sampling
+	// methods, empty for a symmetric alpha.
+	void setTopicAlphas(const vector<double>& topic_alphas) {
+		topic_alphas_ = topic_alphas;
+	}
+
+	// Sample the topics of the given words of the author, in order.
+	void sampleTopicList(Author* author,
+											 const vector<TokenIndex>& word_idxs,
+											 bool remove,
+											 double alpha,
+											 ModelContext* context,
+											 bool inf=false);
+
+private:
+	// Compute the author weights for the author.
+	void initAuthor(Author* author, double alpha, AllTopics* all_topics);
+
+	void sampleTopic(Author* author,
+									 TokenIndex word_idx,
+									 bool remove,
+									 ModelContext* context,
+									 bool inf);
+
+	// Sample the topics of the occurrences of a word group.
+	void sampleGroup(Author* author,
+									 TokenIndex word_idx,
+									 bool remove,
+									 ModelContext* context,
+									 bool inf);
+
+	// Fill word_factors_ for the word.
+	void initWord(int word_id, AllTopics* all_topics);
+
+	// Add (update = 1) or remove (update = -1) the word from its topic
+	// and update the author weight of that topic.
+	void updateTopic(Author* author,
+									 Word word,
+									 int update,
+									 AllTopics* all_topics,
+									 bool inf);
+
+	// Add or remove one occurrence of a word group from the topic,
+	// updating the author weight and the word factor of the topic.
+	void updateUnit(Author* author,
+									int word_id,
+									int topic_id,
+									int update,
+									AllTopics* all_topics,
+									bool inf);
+
+	// Recompute the author weight of the topic.
+	void updateAuthorWeight(Author* author, int topic_id, AllTopics* all_topics);
+
+	// Alpha of each topic for the current author.
+	vector<double> alphas_;
+	vector<double> topic_alphas_;
+
+	// (n_ak + alpha) / (n_k + V eta) for each topic.
+	vector<double> author_weights_;
+
+	// n_kw + eta for each topic, for the current word.
+	vector<double> word_factors_;
+
+	// Cumulative sums for the kernel.
+	vector<double> cdf_;
+};
+
+}  // namespace atm
+
+#endif  // LINEAR_SAMPLER_H_
@@ -0,0 +1,52 @@
+#ifndef MODEL_CONTEXT_H_
+#define MODEL_CONTEXT_H_
+
+#include <utility>
+#include <vector>
+
+#include "author.h"
+#include "document.h"
+#include "topic.h"
+#include "utils.h"
+
+namespace atm {
+
+// The state of one model: the words of its corpus, its authors, its
+// topics and its random number generator. A GibbsState owns one and
+// passes it to the samplers and the utils, nothing of a model is
+// global, so several models can be trained or served in one process,
+// each one from a single thread at a time.
+class ModelContext {
+ public:
+  ModelContext() {}
+
+  ModelContext(const ModelContext& from) = delete;
+  ModelContext& operator=(const ModelContext& from) = delete;
+
+  AllWords* getMutableAllWords() { return &all_words_; }
+  AllAuthors* getMutableAllAuthors() { return &all_authors_; }
+  AllTopics* getMutableAllTopics() { return &all_topics_; }
+  Random* getMutableRandom() { return &random_; }
+
+  // Scratch space of the utils (the per-topic probabilities of a word,
+  // the keys of a sort), reused across calls so that sampling a word does
+  // not allocate. Kept here rather than in statics so that models in
+  // different threads do not share them.
+  vector<double>* getMutableLogPr() { return &log_pr_; }
+  vector<double>* getMutableTopicPr() { return &topic_pr_; }
+  vector<pair<int, TokenIndex>>* getMutableSortKeys() { return &sort_keys_; }
+
+ private:
+  AllWords all_words_;
+  AllAuthors all_authors_;
+  AllTopics all_topics_;
+  Random random_;
+
+  vector<double> log_pr_;
+  vector<double> topic_pr_;
+  vector<pair<int, TokenIndex>> sort_keys_;
+};
+
+}  // namespace atm
+
+#endif  // MODEL_CONTEXT_H_
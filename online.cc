@@ -0,0 +1,405 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "online.h"
+#include "author.h"
+#include "corpus.h"
+#include "gibbs.h"
+#include "utils.h"
+
+#define RESCALE_LIMIT 1e-30
+#define PROGRESS_BATCHES 100
+
+namespace atm {
+
+// =======================================================================
+// OnlineATM
+// =======================================================================
+
+OnlineATM::OnlineATM()
+    : batch_size_(256),
+      epochs_(1),
+      tau_(1.0),
+      kappa_(0.6),
+      local_passes_(5),
+      alpha_(0.0),
+      eta_(0.0),
+      topics_(0),
+      terms_(0),
+      docs_(0),
+      words_(0),
+      updates_(0),
+      topic_word_scale_(1.0),
+      batch_words_total_(0.0) {
+}
+
+double OnlineATM::getStep(double tau, long t) const {
+  return pow(tau + t, -kappa_);
+}
+
+void OnlineATM::scan(const string& filename_corpus,
+                     const string& filename_authors,
+                     int doc_no) {
+  ifstream infile(filename_corpus.c_str());
+  ifstream authors_infile(filename_authors.c_str());
+
+  docs_ = 0;
+  words_ = 0;
+  fill(author_words_.begin(), author_words_.end(), 0);
+
+  vector<int> author_ids;
+  vector<pair<int, int>> word_counts;
+  while ((doc_no <= 0 || docs_ < doc_no) &&
+         CorpusUtils::ReadDocument(infile, authors_infile,
+                                   &author_ids, &word_counts)) {
+    if (author_ids.empty()) {
+      continue;
+    }
+    long doc_words = 0;
+    for (auto& word_count : word_counts) {
+      doc_words += word_count.second;
+    }
+    for (int author_id : author_ids) {
+      author_words_[author_id] += doc_words;
+    }
+    words_ += doc_words;
+    docs_++;
+  }
+
+  infile.close();
+  authors_infile.close();
+}
+
+void OnlineATM::init(GibbsState* gibbs_state) {
+  Corpus* corpus = gibbs_state->getMutableCorpus();
+  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
+  int authors = corpus->getAuthorNo();
+
+  alpha_ = gibbs_state->getAlpha();
+  topics_ = all_topics->getTopics();
+  assert(topics_ > 0);
+  eta_ = all_topics->getMutableTopic(0)->getEta();
+  terms_ = corpus->getWordNo();
+
+  author_words_.assign(authors, 0);
+  author_updates_.assign(authors, 0);
+  author_topic_.assign(static_cast<long>(authors) * topics_, 0.0);
+  author_sum_.assign(authors, 0.0);
+  author_slots_.assign(authors, -1);
+  word_slots_.assign(terms_, -1);
+  updates_ = 0;
+}
+
+void OnlineATM::addDocument(const vector<int>& author_ids,
+                            const vector<pair<int, int>>& word_counts) {
+  // A document without words adds nothing, skip it so that every author
+  // of the minibatch has words to scale its estimate by.
+  double doc_words = 0.0;
+  for (auto& word_count : word_counts) {
+    doc_words += word_count.second;
+  }
+  if (doc_words <= 0.0) {
+    return;
+  }
+
+  batch_author_ids_.push_back(author_ids);
+  batch_word_counts_.push_back(word_counts);
+
+  for (auto& word_count : word_counts) {
+    int word_id = word_count.first;
+    if (word_slots_[word_id] == -1) {
+      word_slots_[word_id] = batch_words_.size();
+      batch_words_.push_back(word_id);
+    }
+  }
+
+  for (int author_id : author_ids) {
+    if (author_slots_[author_id] == -1) {
+      author_slots_[author_id] = batch_authors_.size();
+      batch_authors_.push_back(author_id);
+      batch_author_words_.push_back(0.0);
+    }
+    batch_author_words_[author_slots_[author_id]] += doc_words;
+  }
+
+  batch_words_total_ += doc_words;
+}
+
+void OnlineATM::estimateDocument(int d) {
+  const vector<int>& author_ids = batch_author_ids_[d];
+  int authors = author_ids.size();
+  weights_.resize(static_cast<long>(authors) * topics_);
+  double v_eta = terms_ * eta_;
+  double k_alpha = topics_ * alpha_;
+
+  for (auto& word_count : batch_word_counts_[d]) {
+    int word_id = word_count.first;
+    double count = word_count.second;
+    if (count <= 0) continue;
+
+    double* batch_topic_word =
+        &batch_topic_word_[static_cast<long>(word_slots_[word_id]) * topics_];
+    const double* topic_word =
+        &topic_word_[static_cast<long>(word_id) * topics_];
+
+    double sum = 0.0;
+    for (int j = 0; j < authors; j++) {
+      int slot = author_slots_[author_ids[j]];
+      const double* author_topic =
+          &author_estimate_[static_cast<long>(slot) * topics_];
+      double norm = 1.0 / (author_estimate_sum_[slot] + k_alpha);
+      double* weights = &weights_[j * topics_];
+      for (int k = 0; k < topics_; k++) {
+        weights[k] = norm * (author_topic[k] + alpha_) *
+                     (topic_word_scale_ * topic_word[k] + eta_) /
+                     (topic_sum_[k] + v_eta);
+        sum += weights[k];
+      }
+    }
+
+    if (sum <= 0.0) continue;
+    double scale = count / sum;
+    for (int j = 0; j < authors; j++) {
+      int slot = author_slots_[author_ids[j]];
+      double* batch_author_topic =
+          &batch_author_topic_[static_cast<long>(slot) * topics_];
+      const double* weights = &weights_[j * topics_];
+      for (int k = 0; k < topics_; k++) {
+        double expected = scale * weights[k];
+        batch_author_topic[k] += expected;
+        batch_topic_word[k] += expected;
+      }
+    }
+  }
+}
+
+void OnlineATM::estimateAuthors() {
+  for (size_t s = 0; s < batch_authors_.size(); s++) {
+    int author_id = batch_authors_[s];
+    double author_rho = getStep(1.0, author_updates_[author_id]);
+    double author_scale = author_words_[author_id] / batch_author_words_[s];
+    const double* author_topic =
+        &author_topic_[static_cast<long>(author_id) * topics_];
+    const double* batch_author_topic = &batch_author_topic_[s * topics_];
+    double* author_estimate = &author_estimate_[s * topics_];
+    double author_sum = 0.0;
+    for (int k = 0; k < topics_; k++) {
+      author_estimate[k] = (1.0 - author_rho) * author_topic[k] +
+                           author_rho * author_scale * batch_author_topic[k];
+      author_sum += author_estimate[k];
+    }
+    author_estimate_sum_[s] = author_sum;
+  }
+}
+
+void OnlineATM::updateGlobal() {
+  if (batch_words_total_ > 0.0) {
+    // The first pass uses the global author counts, the next passes the
+    // author counts the minibatch would give.
+    int authors = batch_authors_.size();
+    author_estimate_.resize(static_cast<long>(authors) * topics_);
+    author_estimate_sum_.resize(authors);
+    for (int s = 0; s < authors; s++) {
+      int author_id = batch_authors_[s];
+      copy(&author_topic_[static_cast<long>(author_id) * topics_],
+           &author_topic_[static_cast<long>(author_id + 1) * topics_],
+           &author_estimate_[static_cast<long>(s) * topics_]);
+      author_estimate_sum_[s] = author_sum_[author_id];
+    }
+
+    for (int pass = 0; pass < local_passes_; pass++) {
+      batch_topic_word_.assign(batch_words_.size() * topics_, 0.0);
+      batch_author_topic_.assign(static_cast<long>(authors) * topics_, 0.0);
+      for (size_t d = 0; d < batch_author_ids_.size(); d++) {
+        estimateDocument(d);
+      }
+      estimateAuthors();
+    }
+
+    // Decay all topic-word counts through the scale, then add the
+    // minibatch estimate to the words of the minibatch.
+    double rho = getStep(tau_, updates_++);
+    double corpus_scale = words_ / batch_words_total_;
+    if (rho >= 1.0) {
+      fill(topic_word_.begin(), topic_word_.end(), 0.0);
+      topic_word_scale_ = 1.0;
+    } else {
+      topic_word_scale_ *= (1.0 - rho);
+    }
+    for (int k = 0; k < topics_; k++) {
+      topic_sum_[k] *= (1.0 - rho);
+    }
+    double add = rho * corpus_scale / topic_word_scale_;
+    for (size_t s = 0; s < batch_words_.size(); s++) {
+      double* topic_word =
+          &topic_word_[static_cast<long>(batch_words_[s]) * topics_];
+      const double* batch_topic_word = &batch_topic_word_[s * topics_];
+      for (int k = 0; k < topics_; k++) {
+        topic_word[k] += add * batch_topic_word[k];
+        topic_sum_[k] += rho * corpus_scale * batch_topic_word[k];
+      }
+    }
+
+    if (topic_word_scale_ < RESCALE_LIMIT) {
+      for (size_t i = 0; i < topic_word_.size(); i++) {
+        topic_word_[i] *= topic_word_scale_;
+      }
+      topic_word_scale_ = 1.0;
+    }
+
+    // The authors take the estimate of the last pass.
+    for (int s = 0; s < authors; s++) {
+      int author_id = batch_authors_[s];
+      copy(&author_estimate_[static_cast<long>(s) * topics_],
+           &author_estimate_[static_cast<long>(s + 1) * topics_],
+           &author_topic_[static_cast<long>(author_id) * topics_]);
+      author_sum_[author_id] = author_estimate_sum_[s];
+      author_updates_[author_id]++;
+    }
+  }
+
+  for (int word_id : batch_words_) {
+    word_slots_[word_id] = -1;
+  }
+  for (int author_id : batch_authors_) {
+    author_slots_[author_id] = -1;
+  }
+  batch_author_ids_.clear();
+  batch_word_counts_.clear();
+  batch_words_.clear();
+  batch_authors_.clear();
+  batch_author_words_.clear();
+  batch_words_total_ = 0.0;
+}
+
+void OnlineATM::exportCounts(GibbsState* gibbs_state) {
+  AllTopics* all_topics = gibbs_state->getMutableAllTopics();
+  AllAuthors* all_authors =
+      gibbs_state->getMutableContext()->getMutableAllAuthors();
+
+  for (int k = 0; k < topics_; k++) {
+    Topic* topic = all_topics->getMutableTopic(k);
+    TokenIndex topic_word_no = 0;
+    for (int w = 0; w < terms_; w++) {
+      int count = lround(topic_word_scale_ *
+                         topic_word_[static_cast<long>(w) * topics_ + k]);
+      topic->setWordCount(w, count);
+      topic_word_no += count;
+    }
+    topic->setTopicWordNo(topic_word_no);
+  }
+  all_topics->indexWordTopics();
+
+  for (int a = 0; a < all_authors->getAuthors(); a++) {
+    Author* author = all_authors->getMutableAuthor(a);
+    for (int k = 0; k < topics_; k++) {
+      author->setTopicCounts(
+          k, lround(author_topic_[static_cast<long>(a) * topics_ + k]));
+    }
+  }
+}
+
+void OnlineATM::train(GibbsState* gibbs_state,
+                      const string& filename_corpus,
+                      const string& filename_authors,
+                      int doc_no) {
+  init(gibbs_state);
+  scan(filename_corpus, filename_authors, doc_no);
+  cout << "Online training on " << docs_ << " documents, "
+       << words_ << " words" << endl;
+
+  // Random topic-word counts, each topic gets about words / topics.
+  topic_word_.resize(static_cast<long>(terms_) * topics_);
+  topic_word_scale_ = 1.0;
+  topic_sum_.assign(topics_, 0.0);
+  double mean = 2.0 * words_ / (static_cast<double>(terms_) * topics_);
+  Random* random = gibbs_state->getMutableContext()->getMutableRandom();
+  random->fillUniform(topic_word_.data(), topic_word_.size());
+  for (int w = 0; w < terms_; w++) {
+    for (int k = 0; k < topics_; k++) {
+      double& count = topic_word_[static_cast<long>(w) * topics_ + k];
+      count *= mean;
+      topic_sum_[k] += count;
+    }
+  }
+
+  char filename_other[100];
+  char filename_topics[100];
+  char filename_topics_count[100];
+  sprintf(filename_other, "result/train.other");
+  ofstream ofs("result/train-likelihood.dat");
+
+  vector<int> author_ids;
+  vector<pair<int, int>> word_counts;
+  for (int epoch = 0; epoch < epochs_; epoch++) {
+    ifstream infile(filename_corpus.c_str());
+    ifstream authors_infile(filename_authors.c_str());
+
+    clock_t start = clock();
+    int docs = 0;
+    int batch_docs = 0;
+    long batches = 0;
+    while (docs < docs_ &&
+           CorpusUtils::ReadDocument(infile, authors_infile,
+                                     &author_ids, &word_counts)) {
+      if (author_ids.empty()) {
+        continue;
+      }
+      addDocument(author_ids, word_counts);
+      docs++;
+      if (++batch_docs == batch_size_) {
+        updateGlobal();
+        batch_docs = 0;
+        if (++batches % PROGRESS_BATCHES == 0) {
+          double time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+          cout << "Online epoch " << epoch << ": " << docs << " documents";
+          if (time > 0.0) {
+            cout << " (" << static_cast<long>(docs / time) << " documents/s)";
+          }
+          cout << endl;
+        }
+      }
+    }
+    if (batch_docs > 0) {
+      updateGlobal();
+    }
+    infile.close();
+    authors_infile.close();
+
+    double time = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    gibbs_state->incIteration(1);
+    exportCounts(gibbs_state);
+    double score = gibbs_state->computeGibbsScore();
+    cout << "Online epoch " << epoch << ": " << docs << " documents in "
+         << time << "s";
+    if (time > 0.0) {
+      cout << " (" << static_cast<long>(docs / time) << " documents/s)";
+    }
+    cout << endl;
+    cout << "Gibbs score at iteration "
+         << gibbs_state->getIteration() << " = " << score << endl;
+    ofs << score << endl;
+
+    sprintf(filename_topics, "result/train-topics-%3d.dat", epoch);
+    sprintf(filename_topics_count, "result/train-topics-counts-%3d.dat", epoch);
+    GibbsSampler::SaveState(gibbs_state, filename_other, filename_topics,
+                            filename_topics_count);
+  }
+  ofs.close();
+
+  sprintf(filename_topics, "result/train-topics-final.dat");
+  sprintf(filename_topics_count, "result/train-topics-counts-final.dat");
+  GibbsSampler::SaveState(gibbs_state, filename_other, filename_topics,
+                          filename_topics_count);
+  AllAuthorsUtils::SaveAuthors(
+      gibbs_state->getMutableContext()->getMutableAllAuthors(),
+      "result/train-author-counts-final.dat");
+}
+
+}  // namespace atm
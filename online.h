@@ -0,0 +1,144 @@
+#ifndef ONLINE_H_
+#define ONLINE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace atm {
+
+class GibbsState;
+
+// Online stochastic variational training of the author-topic model, for
+// corpora that do not fit in memory.
+// Documents are streamed from the corpus and authors files in minibatches
+// and never stored. The responsibilities of a word over the (author,
+// topic) pairs of its document are
+//   gamma(a, k) ~ (n_ak + alpha) / (n_a + K alpha) *
+//                 (n_kw + eta) / (n_k + V eta)
+// with the current global expected counts. After each minibatch the
+// topic-word counts move towards the minibatch estimate scaled to the
+// corpus with the step (tau + t)^-kappa. The author-topic counts of each
+// author in the minibatch move towards its estimate scaled to the words
+// of the author, with the step (1 + t_a)^-kappa of the t_a-th update of
+// the author, so that the first update of an author replaces its prior.
+// Each minibatch takes local_passes passes, every pass computes the
+// responsibilities with the author counts given by the previous one.
+// Only the global counts and one minibatch are kept,
+// topics x words + authors x topics.
+class OnlineATM {
+ public:
+  OnlineATM();
+
+  // Train on the first doc_no documents of the files (all if doc_no is
+  // 0 or more than the documents), for the number of epochs. The topics
+  // and authors of the Gibbs state (created by ReadGibbsInput) receive
+  // the rounded expected counts, the topics are checkpointed every epoch
+  // as in GibbsSampler::TrainByPart.
+  void train(GibbsState* gibbs_state,
+             const string& filename_corpus,
+             const string& filename_authors,
+             int doc_no);
+
+  void setBatchSize(int batch_size) { batch_size_ = batch_size; }
+  int getBatchSize() const { return batch_size_; }
+
+  void setEpochs(int epochs) { epochs_ = epochs; }
+  int getEpochs() const { return epochs_; }
+
+  // Step size (tau + t)^-kappa, kappa in (0.5, 1].
+  void setTau(double tau) { tau_ = tau; }
+  void setKappa(double kappa) { kappa_ = kappa; }
+
+  // Passes over a minibatch, refining the author counts between passes.
+  void setLocalPasses(int local_passes) { local_passes_ = local_passes; }
+
+ private:
+  // Count the documents and the words of the corpus and of each author
+  // in the first doc_no documents.
+  void scan(const string& filename_corpus,
+            const string& filename_authors,
+            int doc_no);
+
+  // Random topic-word counts adding up to the words of the corpus.
+  void init(GibbsState* gibbs_state);
+
+  // Add the document to the minibatch, unless it has no words.
+  void addDocument(const vector<int>& author_ids,
+                   const vector<pair<int, int>>& word_counts);
+
+  // Add the responsibilities of the minibatch document d to the
+  // minibatch statistics, with the author estimates.
+  void estimateDocument(int d);
+
+  // Author counts that the minibatch statistics would give.
+  void estimateAuthors();
+
+  // Estimate the minibatch statistics with local_passes passes, move the
+  // global counts towards them and clear the minibatch.
+  void updateGlobal();
+
+  // Round the expected counts into the topics and authors.
+  void exportCounts(GibbsState* gibbs_state);
+
+  // Step of the update t, (tau + t)^-kappa.
+  double getStep(double tau, long t) const;
+
+  int batch_size_;
+  int epochs_;
+  double tau_;
+  double kappa_;
+  int local_passes_;
+
+  double alpha_;
+  double eta_;
+  int topics_;
+  int terms_;
+
+  // Documents and words trained on, and the words of each author.
+  int docs_;
+  long words_;
+  vector<long> author_words_;
+
+  // Global updates so far, and per author.
+  long updates_;
+  vector<long> author_updates_;
+
+  // Topic-word counts n_kw (words x topics, word-major) are
+  // topic_word_ * topic_word_scale_, so that the decay of an update
+  // only touches the words of the minibatch.
+  vector<double> topic_word_;
+  double topic_word_scale_;
+  vector<double> topic_sum_;
+
+  // Author-topic counts n_ak (authors x topics) and n_a.
+  vector<double> author_topic_;
+  vector<double> author_sum_;
+
+  // Documents of the minibatch.
+  vector<vector<int>> batch_author_ids_;
+  vector<vector<pair<int, int>>> batch_word_counts_;
+
+  // Minibatch statistics, by slot of the words and authors it touches.
+  vector<int> word_slots_;
+  vector<int> batch_words_;
+  vector<double> batch_topic_word_;
+  vector<int> author_slots_;
+  vector<int> batch_authors_;
+  vector<double> batch_author_topic_;
+  vector<double> batch_author_words_;
+  double batch_words_total_;
+
+  // Author counts used for the responsibilities, by author slot.
+  vector<double> author_estimate_;
+  vector<double> author_estimate_sum_;
+
+  // Scratch for the responsibilities of a word.
+  vector<double> weights_;
+};
+
+}  // namespace atm
+
+#endif  // ONLINE_H_
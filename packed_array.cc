@@ -0,0 +1,58 @@
+#include "packed_array.h"
+
+namespace atm {
+
+// =======================================================================
+// PackedArray
+// =======================================================================
+
+PackedArray::PackedArray()
+    : bits_(1),
+      mask_(1),
+      size_(0),
+      data_(1, 0) {
+}
+
+void PackedArray::push_back(uint32_t value) {
+  if (value > mask_) {
+    widen(value);
+  }
+  if (data_.size() < getWords(size_ + 1, bits_)) {
+    data_.resize(getWords(2 * size_ + 1, bits_), 0);
+  }
+  size_++;
+  set(size_ - 1, value);
+}
+
+void PackedArray::reserve(size_t size) {
+  data_.reserve(getWords(size, bits_));
+}
+
+void PackedArray::assign(size_t size, uint32_t max_value) {
+  bits_ = 1;
+  mask_ = 1;
+  size_ = size;
+  data_.assign(getWords(size, bits_), 0);
+  if (max_value > mask_) {
+    widen(max_value);
+  }
+}
+
+void PackedArray::widen(uint32_t value) {
+  int bits = bits_;
+  while (bits < 32 && (value >> bits) != 0) {
+    bits++;
+  }
+
+  PackedArray widened;
+  widened.bits_ = bits;
+  widened.mask_ = (bits == 32) ? 0xffffffffULL : ((1ULL << bits) - 1);
+  widened.size_ = size_;
+  widened.data_.assign(getWords(data_.size() * 64 / bits_, bits), 0);
+  for (size_t i = 0; i < size_; i++) {
+    widened.set(i, get(i));
+  }
+  *this = move(widened);
+}
+
+}  // namespace atm
@@ -0,0 +1,79 @@
+#ifndef PACKED_ARRAY_H_
+#define PACKED_ARRAY_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+using namespace std;
+
+namespace atm {
+
+// Array of unsigned values packed in getBits() bits each, back to back
+// in 64-bit words. The width follows the largest value stored: a value
+// that does not fit repacks the array one bit wider per missing bit, so
+// widening is rare and amortized. Reads and writes are a few shifts
+// and masks on at most two consecutive 64-bit words, and a scan of the
+// array reads memory sequentially.
+class PackedArray {
+ public:
+  PackedArray();
+
+  size_t size() const { return size_; }
+  int getBits() const { return bits_; }
+  size_t getBytes() const { return data_.size() * sizeof(uint64_t); }
+
+  uint32_t get(size_t i) const {
+    uint64_t bit = static_cast<uint64_t>(i) * bits_;
+    size_t word = bit >> 6;
+    int offset = bit & 63;
+    uint64_t value = data_[word] >> offset;
+    if (offset + bits_ > 64) {
+      value |= data_[word + 1] << (64 - offset);
+    }
+    return value & mask_;
+  }
+
+  void set(size_t i, uint32_t value) {
+    if (value > mask_) {
+      widen(value);
+    }
+    uint64_t bit = static_cast<uint64_t>(i) * bits_;
+    size_t word = bit >> 6;
+    int offset = bit & 63;
+    data_[word] = (data_[word] & ~(mask_ << offset)) |
+                  (static_cast<uint64_t>(value) << offset);
+    if (offset + bits_ > 64) {
+      int written = 64 - offset;
+      data_[word + 1] = (data_[word + 1] & ~(mask_ >> written)) |
+                        (static_cast<uint64_t>(value) >> written);
+    }
+  }
+
+  void push_back(uint32_t value);
+
+  // Make room for size values at the current width.
+  void reserve(size_t size);
+
+  // Hold size values, all 0, in the width of max_value.
+  void assign(size_t size, uint32_t max_value);
+
+ private:
+  // Repack the values with enough bits for value.
+  void widen(uint32_t value);
+
+  // 64-bit words holding size values of the width, plus one so that a
+  // value never reads past the end.
+  size_t getWords(size_t size, int bits) const {
+    return (static_cast<uint64_t>(size) * bits + 63) / 64 + 1;
+  }
+
+  int bits_;
+  uint64_t mask_;
+  size_t size_;
+  vector<uint64_t> data_;
+};
+
+}  // namespace atm
+
+#endif  // PACKED_ARRAY_H_
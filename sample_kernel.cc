@@ -0,0 +1,229 @@
+#include <assert.h>
+
+#include "sample_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ATM_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace atm {
+
+// =======================================================================
+// SampleKernel
+// =======================================================================
+
+KernelIsa SampleKernel::ISA = SampleKernel::DetectIsa();
+
+KernelIsa SampleKernel::DetectIsa() {
+#ifdef ATM_KERNEL_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return KERNEL_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return KERNEL_AVX2;
+  }
+#endif
+  return KERNEL_SCALAR;
+}
+
+void SampleKernel::SetIsa(KernelIsa isa) {
+  KernelIsa supported = DetectIsa();
+  ISA = (isa <= supported) ? isa : supported;
+}
+
+const char* SampleKernel::GetIsaName() {
+  switch (ISA) {
+    case KERNEL_AVX512:
+      return "avx512";
+    case KERNEL_AVX2:
+      return "avx2";
+    case KERNEL_SCALAR:
+    default:
+      return "scalar";
+  }
+}
+
+int SampleKernel::Sample(const double* weights,
+                         const double* factors,
+                         double* cdf,
+                         int size,
+                         double rand_no) {
+  assert(size > 0);
+  switch (size) {
+    case 16:
+      return SampleSized<16>(weights, factors, cdf, size, rand_no);
+    case 32:
+      return SampleSized<32>(weights, factors, cdf, size, rand_no);
+    case 50:
+      return SampleSized<50>(weights, factors, cdf, size, rand_no);
+    case 64:
+      return SampleSized<64>(weights, factors, cdf, size, rand_no);
+    case 100:
+      return SampleSized<100>(weights, factors, cdf, size, rand_no);
+    case 128:
+      return SampleSized<128>(weights, factors, cdf, size, rand_no);
+    default:
+      return SampleSized<0>(weights, factors, cdf, size, rand_no);
+  }
+}
+
+template <int SIZE>
+int SampleKernel::SampleSized(const double* weights,
+                              const double* factors,
+                              double* cdf,
+                              int size,
+                              double rand_no) {
+  switch (ISA) {
+    case KERNEL_AVX512:
+      return SampleAvx512<SIZE>(weights, factors, cdf, size, rand_no);
+    case KERNEL_AVX2:
+      return SampleAvx2<SIZE>(weights, factors, cdf, size, rand_no);
+    case KERNEL_SCALAR:
+    default:
+      return SampleScalar<SIZE>(weights, factors, cdf, size, rand_no);
+  }
+}
+
+template <int SIZE>
+int SampleKernel::SampleScalar(const double* weights,
+                               const double* factors,
+                               double* cdf,
+                               int size,
+                               double rand_no) {
+  if (SIZE > 0) size = SIZE;
+  double sum = 0.0;
+  for (int i = 0; i < size; i++) {
+    sum += weights[i] * factors[i];
+    cdf[i] = sum;
+  }
+
+  double target = rand_no * sum;
+  for (int i = 0; i < size; i++) {
+    if (cdf[i] > target) return i;
+  }
+  return size - 1;
+}
+
+#ifdef ATM_KERNEL_X86
+
+template <int SIZE>
+__attribute__((target("avx2")))
+int SampleKernel::SampleAvx2(const double* weights,
+                             const double* factors,
+                             double* cdf,
+                             int size,
+                             double rand_no) {
+  if (SIZE > 0) size = SIZE;
+  const __m256d zero = _mm256_setzero_pd();
+  __m256d carry = zero;
+  int i = 0;
+
+  // Cumulative sum, four products at a time: the prefix sum of a block
+  // takes two shift-and-add steps, then the carry of the previous
+  // block is added.
+  for (; i + 4 <= size; i += 4) {
+    __m256d x = _mm256_mul_pd(_mm256_loadu_pd(weights + i),
+                              _mm256_loadu_pd(factors + i));
+    x = _mm256_add_pd(x, _mm256_blend_pd(
+        _mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1));
+    x = _mm256_add_pd(x, _mm256_permute2f128_pd(x, x, 0x08));
+    x = _mm256_add_pd(x, carry);
+    _mm256_storeu_pd(cdf + i, x);
+    carry = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+  double sum = _mm256_cvtsd_f64(carry);
+  for (; i < size; i++) {
+    sum += weights[i] * factors[i];
+    cdf[i] = sum;
+  }
+
+  // Find the first entry above the target.
+  double target = rand_no * sum;
+  const __m256d target_v = _mm256_set1_pd(target);
+  for (i = 0; i + 4 <= size; i += 4) {
+    int mask = _mm256_movemask_pd(
+        _mm256_cmp_pd(_mm256_loadu_pd(cdf + i), target_v, _CMP_GT_OQ));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  for (; i < size; i++) {
+    if (cdf[i] > target) return i;
+  }
+  return size - 1;
+}
+
+template <int SIZE>
+__attribute__((target("avx512f")))
+int SampleKernel::SampleAvx512(const double* weights,
+                               const double* factors,
+                               double* cdf,
+                               int size,
+                               double rand_no) {
+  if (SIZE > 0) size = SIZE;
+  // Lane j of a shift by s takes lane j - s, the low s lanes are masked.
+  const __m512i shift1 = _mm512_set_epi64(6, 5, 4, 3, 2, 1, 0, 0);
+  const __m512i shift2 = _mm512_set_epi64(5, 4, 3, 2, 1, 0, 0, 0);
+  const __m512i shift4 = _mm512_set_epi64(3, 2, 1, 0, 0, 0, 0, 0);
+  const __m512i last = _mm512_set1_epi64(7);
+  __m512d carry = _mm512_setzero_pd();
+  int i = 0;
+
+  // Cumulative sum, eight products at a time.
+  for (; i + 8 <= size; i += 8) {
+    __m512d x = _mm512_mul_pd(_mm512_loadu_pd(weights + i),
+                              _mm512_loadu_pd(factors + i));
+    x = _mm512_add_pd(x, _mm512_maskz_permutexvar_pd(0xFE, shift1, x));
+    x = _mm512_add_pd(x, _mm512_maskz_permutexvar_pd(0xFC, shift2, x));
+    x = _mm512_add_pd(x, _mm512_maskz_permutexvar_pd(0xF0, shift4, x));
+    x = _mm512_add_pd(x, carry);
+    _mm512_storeu_pd(cdf + i, x);
+    carry = _mm512_mask_permutexvar_pd(x, 0xFF, last, x);
+  }
+  double sum = _mm512_cvtsd_f64(carry);
+  for (; i < size; i++) {
+    sum += weights[i] * factors[i];
+    cdf[i] = sum;
+  }
+
+  // Find the first entry above the target.
+  double target = rand_no * sum;
+  const __m512d target_v = _mm512_set1_pd(target);
+  for (i = 0; i + 8 <= size; i += 8) {
+    __mmask8 mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(cdf + i), target_v,
+                                       _CMP_GT_OQ);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  for (; i < size; i++) {
+    if (cdf[i] > target) return i;
+  }
+  return size - 1;
+}
+
+#else
+
+template <int SIZE>
+int SampleKernel::SampleAvx2(const double* weights,
+                             const double* factors,
+                             double* cdf,
+                             int size,
+                             double rand_no) {
+  return SampleScalar<SIZE>(weights, factors, cdf, size, rand_no);
+}
+
+template <int SIZE>
+int SampleKernel::SampleAvx512(const double* weights,
+                               const double* factors,
+                               double* cdf,
+                               int size,
+                               double rand_no) {
+  return SampleScalar<SIZE>(weights, factors, cdf, size, rand_no);
+}
+
+#endif  // ATM_KERNEL_X86
+
+}  // namespace atm
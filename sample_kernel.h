@@ -0,0 +1,61 @@
+#ifndef SAMPLE_KERNEL_H_
+#define SAMPLE_KERNEL_H_
+
+namespace atm {
+
+// Instruction sets of the sampling kernel.
+enum KernelIsa {
+  KERNEL_SCALAR,
+  KERNEL_AVX2,
+  KERNEL_AVX512
+};
+
+// Dense sampling kernel in linear space.
+// Draws an index i with probability proportional to
+// weights[i] * factors[i], building the cumulative sum in cdf
+// with SIMD and searching it with vector compares.
+// The instruction set is picked at runtime from what the CPU supports,
+// the log space Utils::SampleFromLogPr stays the reference.
+// Common sizes (16, 32, 50, 64, 100 and 128 topics) use kernels
+// instantiated for that size, so that the compiler fully unrolls them.
+class SampleKernel {
+ public:
+  // Draw an index, weights and factors are nonnegative with a
+  // positive sum of products, cdf holds at least size doubles and
+  // rand_no is uniform in [0, 1).
+  static int Sample(const double* weights,
+                    const double* factors,
+                    double* cdf,
+                    int size,
+                    double rand_no);
+
+  // The best instruction set supported by this CPU.
+  static KernelIsa DetectIsa();
+
+  // Use the given instruction set, or the best supported one
+  // if the CPU does not support it.
+  static void SetIsa(KernelIsa isa);
+  static KernelIsa GetIsa() { return ISA; }
+  static const char* GetIsaName();
+
+ private:
+  // Kernels for SIZE weights, or for size weights if SIZE is 0.
+  template <int SIZE>
+  static int SampleSized(const double* weights, const double* factors,
+                         double* cdf, int size, double rand_no);
+  template <int SIZE>
+  static int SampleScalar(const double* weights, const double* factors,
+                          double* cdf, int size, double rand_no);
+  template <int SIZE>
+  static int SampleAvx2(const double* weights, const double* factors,
+                        double* cdf, int size, double rand_no);
+  template <int SIZE>
+  static int SampleAvx512(const double* weights, const double* factors,
+                          double* cdf, int size, double rand_no);
+
+  static KernelIsa ISA;
+};
+
+}  // namespace atm
+
+#endif  // SAMPLE_KERNEL_H_
@@ -0,0 +1,166 @@
+#include <assert.h>
+
+#include "sparse_sampler.h"
+#include "model_context.h"
+#include "utils.h"
+
+namespace atm {
+
+// =======================================================================
+// SparseSampler
+// =======================================================================
+
+SparseSampler::SparseSampler()
+		: alpha_(0.0),
+		  smoothing_sum_(0.0),
+		  author_sum_(0.0) {
+}
+
+void SparseSampler::initAuthor(Author* author,
+															 double alpha,
+															 AllTopics* all_topics) {
+	int topics = all_topics->getTopics();
+	alpha_ = alpha;
+	smoothing_sum_ = 0.0;
+	author_sum_ = 0.0;
+	denominators_.resize(topics);
+	coefficients_.resize(topics);
+	word_pr_.resize(topics);
+
+	for (int i = 0; i < topics; i++) {
+		Topic* topic = all_topics->getMutableTopic(i);
+		double eta = topic->getEta();
+		double denominator = eta * topic->getCorpusWordNo() +
+												 topic->getTopicWordNo();
+
+		denominators_[i] = denominator;
+		coefficients_[i] = alpha / denominator;
+		smoothing_sum_ += alpha * eta / denominator;
+	}
+	for (int i = 0; i < author->getNonzeroTopics(); i++) {
+		int topic_id = author->getNonzeroTopic(i);
+		int topic_count = author->getNonzeroCount(i);
+		double eta = all_topics->getMutableTopic(topic_id)->getEta();
+		coefficients_[topic_id] =
+				(topic_count + alpha) / denominators_[topic_id];
+		author_sum_ += topic_count * eta / denominators_[topic_id];
+	}
+}
+
+void SparseSampler::updateTopic(Author* author,
+																Word word,
+																int update,
+																AllTopics* all_topics,
+																bool inf) {
+	int topic_id = word.getTopicId();
+	if (topic_id == -1) {
+		return;
+	}
+
+	Topic* topic = all_topics->getMutableTopic(topic_id);
+	double eta = topic->getEta();
+	double denominator = denominators_[topic_id];
+	int topic_count = author->getTopicCounts(topic_id);
+	smoothing_sum_ -= alpha_ * eta / denominator;
+	author_sum_ -= topic_count * eta / denominator;
+
+	AuthorUtils::UpdateTopicFromWord(author, word, update, all_topics, inf);
+
+	denominator = eta * topic->getCorpusWordNo() + topic->getTopicWordNo();
+	topic_count += update;
+	denominators_[topic_id] = denominator;
+	coefficients_[topic_id] = (topic_count + alpha_) / denominator;
+	smoothing_sum_ += alpha_ * eta / denominator;
+	author_sum_ += topic_count * eta / denominator;
+}
+
+void SparseSampler::sampleTopic(Author* author,
+																TokenIndex word_idx,
+																bool remove,
+																ModelContext* context,
+																bool inf) {
+	AllTopics* all_topics = context->getMutableAllTopics();
+	Word word = context->getMutableAllWords()->getMutableWord(word_idx);
+	if (remove) {
+		updateTopic(author, word, -1, all_topics, inf);
+	}
+
+	// Word bucket over the topics the word is assigned to.
+	int word_id = word.getId();
+	const vector<int>& word_topics = all_topics->getWordTopics(word_id);
+	int word_topic_no = word_topics.size();
+	double word_sum = 0.0;
+	for (int i = 0; i < word_topic_no; i++) {
+		int topic_id = word_topics[i];
+		word_pr_[i] = coefficients_[topic_id] *
+									all_topics->getWordTopicCount(word_id, i);
+		word_sum += word_pr_[i];
+	}
+
+	double rand_no = context->getMutableRandom()->uniform() *
+									 (smoothing_sum_ + author_sum_ + word_sum);
+	int sample_topic_id = -1;
+
+	if (rand_no < word_sum) {
+		for (int i = 0; i < word_topic_no; i++) {
+			sample_topic_id = word_topics[i];
+			rand_no -= word_pr_[i];
+			if (rand_no <= 0.0) break;
+		}
+	} else {
+		rand_no -= word_sum;
+		if (rand_no < author_sum_) {
+			int author_topic_no = author->getNonzeroTopics();
+			for (int i = 0; i < author_topic_no; i++) {
+				int topic_id = author->getNonzeroTopic(i);
+				Topic* topic = all_topics->getMutableTopic(topic_id);
+				sample_topic_id = topic_id;
+				rand_no -= author->getNonzeroCount(i) * topic->getEta() /
+									 denominators_[topic_id];
+				if (rand_no <= 0.0) break;
+			}
+		} else {
+			rand_no -= author_sum_;
+		}
+
+		// Smoothing bucket, also taken if rounding left the author
+		// bucket without a sample.
+		if (sample_topic_id == -1) {
+			int topics = all_topics->getTopics();
+			for (int i = 0; i < topics; i++) {
+				Topic* topic = all_topics->getMutableTopic(i);
+				sample_topic_id = i;
+				rand_no -= alpha_ * topic->getEta() / denominators_[i];
+				if (rand_no <= 0.0) break;
+			}
+		}
+	}
+	assert(sample_topic_id != -1);
+
+	word.setTopicId(sample_topic_id);
+	updateTopic(author, word, 1, all_topics, inf);
+}
+
+void SparseSampler::sampleTopics(Author* author,
+																 int permute_words,
+																 bool remove,
+																 double alpha,
+																 ModelContext* context,
+																 bool inf) {
+	int author_word_count = author->getWords();
+	if (author_word_count == 0) return;
+
+	// Permute the words in the author.
+	if (permute_words == 1) {
+		AuthorUtils::PermuteWords(author, context);
+	}
+
+	initAuthor(author, alpha, context->getMutableAllTopics());
+
+	for (int i = 0; i < author_word_count; i++) {
+		TokenIndex word_idx = author->getWord(i);
+		sampleTopic(author, word_idx, remove, context, inf);
+	}
+}
+
+}  // namespace atm
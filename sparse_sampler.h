@@ -0,0 +1,75 @@
+#ifndef SPARSE_SAMPLER_H_
+#define SPARSE_SAMPLER_H_
+
+#include <vector>
+
+#include "author.h"
+#include "topic.h"
+
+using namespace std;
+
+namespace atm {
+
+// SparseLDA-style topic sampler (Yao, Mimno and McCallum, 2009).
+// The conditional of a word w of author a being assigned to topic k,
+//   (n_ak + alpha) (n_kw + eta) / (n_k + V eta),
+// is split into three buckets:
+//   smoothing s = sum_k alpha eta / (n_k + V eta),
+//   author    r = sum_{k: n_ak > 0} n_ak eta / (n_k + V eta),
+//   word      q = sum_{k: n_kw > 0} (n_ak + alpha) n_kw / (n_k + V eta).
+// s and r are set up once per author and then updated incrementally,
+// q is computed over the nonzero topics of the word only, so a word
+// costs O(nonzero topics) rather than O(topics).
+// Draws from the same distribution as AuthorUtils::SampleTopics.
+class SparseSampler {
+public:
+	SparseSampler();
+
+	// Sample the word topics for a given author,
+	// with the same arguments as AuthorUtils::SampleTopics.
+	void sampleTopics(Author* author,
+										int permute_words,
+										bool remove,
+										double alpha,
+										ModelContext* context,
+										bool inf=false);
+
+private:
+	// Compute the buckets and per-topic caches for the author.
+	void initAuthor(Author* author, double alpha, AllTopics* all_topics);
+
+	void sampleTopic(Author* author,
+									 TokenIndex word_idx,
+									 bool remove,
+									 ModelContext* context,
+									 bool inf);
+
+	// Add (update = 1) or remove (update = -1) the word from its topic
+	// and update the buckets and caches of that topic.
+	void updateTopic(Author* author,
+									 Word word,
+									 int update,
+									 AllTopics* all_topics,
+									 bool inf);
+
+	double alpha_;
+
+	// Smoothing bucket s.
+	double smoothing_sum_;
+
+	// Author bucket r.
+	double author_sum_;
+
+	// n_k + V eta for each topic.
+	vector<double> denominators_;
+
+	// (n_ak + alpha) / (n_k + V eta) for each topic.
+	vector<double> coefficients_;
+
+	// Word bucket masses of the nonzero topics of the current word.
+	vector<double> word_pr_;
+};
+
+}  // namespace atm
+
+#endif  // SPARSE_SAMPLER_H_
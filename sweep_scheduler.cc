@@ -0,0 +1,99 @@
+#include "sweep_scheduler.h"
+
+#define MAX_STABLE 30
+
+namespace atm {
+
+// =======================================================================
+// SweepScheduler
+// =======================================================================
+
+SweepScheduler::SweepScheduler()
+		: burn_in_(100),
+		  max_period_(8),
+		  author_churn_(0.3),
+		  words_(0),
+		  visited_(0),
+		  changed_(0),
+		  full_rate_authors_(0) {
+}
+
+void SweepScheduler::init(TokenIndex words, int authors) {
+	stable_.assign(words, 0);
+	author_churns_.assign(authors, 1.0);
+	resetStats();
+}
+
+double SweepScheduler::getChurn() const {
+	if (visited_ == 0) return 0.0;
+	return static_cast<double>(changed_) / visited_;
+}
+
+void SweepScheduler::resetStats() {
+	words_ = 0;
+	visited_ = 0;
+	changed_ = 0;
+	full_rate_authors_ = 0;
+}
+
+const vector<TokenIndex>& SweepScheduler::selectWords(Author* author,
+																							 int iteration,
+																							 AllWords* all_words) {
+	int author_word_count = author->getWords();
+	bool full_rate = (iteration < burn_in_ ||
+										author_churns_[author->getId()] > author_churn_);
+	if (full_rate && author_word_count > 0) {
+		full_rate_authors_++;
+	}
+
+	selected_.clear();
+	selected_topics_.clear();
+	for (int i = 0; i < author_word_count; i++) {
+		TokenIndex word_idx = author->getWord(i);
+		Word word = all_words->getMutableWord(word_idx);
+		bool visit = full_rate || word.getTopicId() == -1 ||
+								 word.getCount() > 1;
+		if (!visit) {
+			int stable = stable_[word_idx];
+			int period = max_period_;
+			if (stable < MAX_STABLE && (1 << stable) < max_period_) {
+				period = 1 << stable;
+			}
+			visit = ((iteration + word_idx) % period == 0);
+		}
+		if (visit) {
+			selected_.push_back(word_idx);
+			selected_topics_.push_back(word.getTopicId());
+		}
+	}
+
+	words_ += author_word_count;
+	return selected_;
+}
+
+void SweepScheduler::updateChurn(Author* author, AllWords* all_words) {
+	int selected = selected_.size();
+	int changed = 0;
+	for (int i = 0; i < selected; i++) {
+		TokenIndex word_idx = selected_[i];
+		Word word = all_words->getMutableWord(word_idx);
+		// Word groups and words without a topic before the sweep count
+		// as changed.
+		if (word.getCount() > 1 || selected_topics_[i] == -1 ||
+				selected_topics_[i] != word.getTopicId()) {
+			stable_[word_idx] = 0;
+			changed++;
+		} else if (stable_[word_idx] < MAX_STABLE) {
+			stable_[word_idx]++;
+		}
+	}
+
+	if (selected > 0) {
+		author_churns_[author->getId()] =
+				static_cast<double>(changed) / selected;
+	}
+	visited_ += selected;
+	changed_ += changed;
+}
+
+}  // namespace atm
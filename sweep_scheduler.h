@@ -0,0 +1,80 @@
+#ifndef SWEEP_SCHEDULER_H_
+#define SWEEP_SCHEDULER_H_
+
+#include <vector>
+
+#include "author.h"
+#include "document.h"
+
+using namespace std;
+
+namespace atm {
+
+// Scheduler of selective sweeps for the topic phase.
+// After burn_in iterations, a word whose topic did not change in its
+// last s visits is only visited every min(2^s, max_period) sweeps,
+// staggered by word index. Words without a topic, word groups and all
+// the words of authors whose churn (fraction of visited words that
+// changed topic in the last sweep) is above author_churn are visited
+// every sweep.
+// Skipping words keeps their counts, the sweep is no longer a full
+// Gibbs sweep and trades mixing of stable words for time.
+class SweepScheduler {
+public:
+	SweepScheduler();
+
+	// Reset the churn state for words and authors.
+	void init(TokenIndex words, int authors);
+
+	// Select the words of the author to sample in the sweep of the
+	// given iteration, in the order of the author words, and remember
+	// their topics. all_words holds the words of the author.
+	const vector<TokenIndex>& selectWords(Author* author, int iteration,
+																				AllWords* all_words);
+
+	// Update the churn of the author and of its selected words
+	// after sampling them.
+	void updateChurn(Author* author, AllWords* all_words);
+
+	void setBurnIn(int burn_in) { burn_in_ = burn_in; }
+	int getBurnIn() const { return burn_in_; }
+
+	void setMaxPeriod(int max_period) { max_period_ = max_period; }
+	int getMaxPeriod() const { return max_period_; }
+
+	void setAuthorChurn(double author_churn) { author_churn_ = author_churn; }
+	double getAuthorChurn() const { return author_churn_; }
+
+	// Statistics since the last reset.
+	long getWords() const { return words_; }
+	long getVisited() const { return visited_; }
+	long getChanged() const { return changed_; }
+	int getFullRateAuthors() const { return full_rate_authors_; }
+	// Fraction of visited words that changed topic.
+	double getChurn() const;
+	void resetStats();
+
+private:
+	int burn_in_;
+	int max_period_;
+	double author_churn_;
+
+	// Number of consecutive visits without a topic change, per word.
+	vector<unsigned char> stable_;
+
+	// Churn of the last sweep, per author.
+	vector<double> author_churns_;
+
+	// Selected words of the current author and their topics.
+	vector<TokenIndex> selected_;
+	vector<int> selected_topics_;
+
+	long words_;
+	long visited_;
+	long changed_;
+	int full_rate_authors_;
+};
+
+}  // namespace atm
+
+#endif  // SWEEP_SCHEDULER_H_
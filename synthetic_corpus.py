@@ -0,0 +1,46 @@
+#! /usr/bin/python
+
+# usage: python synthetic_corpus.py <corpus file> <authors file> <documents>
+#            <words per document> <count per word> <vocabulary> <authors>
+#
+# Writes a synthetic corpus in the format of atm: each document has
+# <words per document> distinct word ids drawn from <vocabulary>, each
+# with the count <count per word>, and one author, document d being
+# written by author d % <authors>. The corpus has
+# <documents> * <words per document> * <count per word> words, so a
+# small file can describe a corpus above 2^31 words, for checking a
+# make TOKEN64=1 build (see the README). The same arguments always give
+# the same files.
+
+import random
+import sys
+
+def write_corpus(corpus_file, authors_file, docs, words, count, vocab,
+                 authors):
+    rng = random.Random(1)
+    corpus = open(corpus_file, 'w')
+    author_lines = open(authors_file, 'w')
+    for d in range(docs):
+        ids = rng.sample(range(vocab), words)
+        corpus.write('%d %s\n' % (words,
+                     ' '.join('%d:%d' % (w, count) for w in ids)))
+        author_lines.write('%d\n' % (d % authors))
+    corpus.close()
+    author_lines.close()
+
+    total = docs * words * count
+    sys.stdout.write('%d documents, %d words (2^31 - 1 = %d)\n' %
+                     (docs, total, 2 ** 31 - 1))
+    sys.stdout.write('words per author: %d, occurrences per word: about %d\n'
+                     % (total // authors, total // vocab))
+
+if __name__ == '__main__':
+
+    if (len(sys.argv) != 8):
+        sys.stdout.write('usage: python synthetic_corpus.py <corpus file> '
+                         '<authors file> <documents> <words per document> '
+                         '<count per word> <vocabulary> <authors>\n')
+        sys.exit(1)
+
+    write_corpus(sys.argv[1], sys.argv[2], int(sys.argv[3]), int(sys.argv[4]),
+                 int(sys.argv[5]), int(sys.argv[6]), int(sys.argv[7]))
@@ -0,0 +1,22 @@
+#ifndef TOKEN_INDEX_H_
+#define TOKEN_INDEX_H_
+
+#include <stdint.h>
+
+namespace atm {
+
+// Index of a word in AllWords, and count of words that can reach the
+// size of the corpus (the words of a topic, of the corpus). 32 bits by
+// default, which holds corpora up to 2^31 - 1 words; building with
+// make TOKEN64=1 defines ATM_TOKEN64 and makes it 64 bits, at the cost
+// of twice the memory for the word indices of the documents and the
+// authors. CorpusUtils::ReadCorpus stops on a corpus too large for it.
+#ifdef ATM_TOKEN64
+typedef int64_t TokenIndex;
+#else
+typedef int32_t TokenIndex;
+#endif
+
+}  // namespace atm
+
+#endif  // TOKEN_INDEX_H_
@@ -2,6 +2,7 @@
 #include <assert.h>
 
 #include <gsl/gsl_sf.h>
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -19,60 +20,444 @@ namespace atm {
 // Topic
 // =======================================================================
 Topic::Topic(int corpus_word_no, double eta)
-    : topic_word_no_(0),
+    : topic_word_no_(nullptr),
       corpus_word_no_(corpus_word_no),
-      word_counts_(corpus_word_no, 0),
+      word_counts_(nullptr),
+      stride_(1),
+      all_topics_(nullptr),
+      topic_id_(0),
       eta_(eta) {
 }
 
-void Topic::updateWordCount(int word_id, int update) {
-  // Find the word counts for the word with word_id, and update the counts.
-  word_counts_[word_id] += update;
-  topic_word_no_ += update;
-}
-
 // =======================================================================
 // TopicUtils
 // =======================================================================
 
 void TopicUtils::SaveTopic(
         Topic* topic, 
+        const vector<pair<int, int>>& word_counts,
+        const vector<int>* word_ids,
         ofstream& ofs, 
         ofstream& ofs_count) {
   ofs.precision(12);
   ofs << std::right;
-  for (int i = 0; i < topic->getCorpusWordNo(); i++) {
-    ofs << exp(topic->getLogPrWord(i)) << " ";
-    ofs_count << topic->getWordCount(i) << " ";
+  double eta = topic->getEta();
+  double denominator = eta * topic->getCorpusWordNo() + topic->getTopicWordNo();
+  int word_no = (word_ids != nullptr) ? word_ids->size()
+                                      : topic->getCorpusWordNo();
+  size_t next = 0;
+  for (int i = 0; i < word_no; i++) {
+    // An id that is not in the vocabulary has probability 0.
+    if (word_ids != nullptr && (*word_ids)[i] == -1) {
+      ofs << 0.0 << " ";
+      ofs_count << 0 << " ";
+      continue;
+    }
+    int count = 0;
+    if (next < word_counts.size() && word_counts[next].first == i) {
+      count = word_counts[next++].second;
+    }
+    ofs << exp(log(eta + count) - log(denominator)) << " ";
+    ofs_count << count << " ";
   }
   ofs << endl;
   ofs_count << endl;
 }
 
-double TopicUtils::EtaScore(Topic* topic) {
-  double score = 0.0;
-  int word_count_size = topic->getCorpusWordNo();
-  
-  double eta = topic->getEta();
-  double lgam_eta = gsl_sf_lngamma(eta);
 
-  // The current eta score.
-  score = gsl_sf_lngamma(word_count_size * eta);
 
-  // Update the score based on the pre-computed Gamma (word count + eta)
-  for (int i = 0; i < word_count_size; i++) {
-  	if (topic->getWordCount(i) > 0) {
-  		score += topic->getLgamWordCountEta(i) - lgam_eta;	
-  	}
+// =======================================================================
+// AllTopics
+// =======================================================================
+
+// Topics of a row in the word-major and hybrid layouts are padded to a
+// multiple of 16 ints, a 64-byte cache line.
+const size_t TOPIC_PADDING = 16;
+
+// A word in the hybrid layout gets a dense row above 1/8 of the topics
+// nonzero, and loses it below 1/16.
+const size_t HYBRID_PROMOTE = 8;
+const size_t HYBRID_DEMOTE = 16;
+
+AllTopics::AllTopics()
+    : layout_(TOPIC_LAYOUT_TOPIC),
+      word_no_(0),
+      padded_topics_(0) {
+}
+
+void AllTopics::reserveTopics(int topics) {
+  size_t padded_topics =
+      (topics + TOPIC_PADDING - 1) / TOPIC_PADDING * TOPIC_PADDING;
+  if (padded_topics > padded_topics_) {
+    int topic_no = topics_.size();
+    vector<int> topic_map(topic_no);
+    for (int i = 0; i < topic_no; i++) {
+      topic_map[i] = i;
+    }
+    reshape(layout_, padded_topics, topic_map, topic_no);
+    pointTopics();
+  }
+}
+
+void AllTopics::addTopic(int corpus_word_no, double eta) {
+  int topics = topics_.size();
+  assert(topics == 0 || word_no_ == static_cast<size_t>(corpus_word_no));
+  if (topics == 0 && word_no_ != static_cast<size_t>(corpus_word_no)) {
+    word_no_ = corpus_word_no;
+    word_topics_.assign(word_no_, vector<int>());
+    vector<int> topic_map;
+    reshape(layout_, padded_topics_, topic_map, 0);
+  }
+
+  if (layout_ == TOPIC_LAYOUT_TOPIC) {
+    word_counts_.resize((topics + 1) * word_no_, 0);
+  } else if (static_cast<size_t>(topics) == padded_topics_) {
+    // Double the room so that adding K topics copies O(K V) counts.
+    vector<int> topic_map(topics);
+    for (int i = 0; i < topics; i++) {
+      topic_map[i] = i;
+    }
+    reshape(layout_, max(2 * padded_topics_, TOPIC_PADDING), topic_map,
+            topics);
+  }
+  topic_word_nos_.push_back(0);
+  topics_.emplace_back(Topic(corpus_word_no, eta));
+  pointTopics();
+}
+
+void AllTopics::setLayout(TopicLayout layout) {
+  int topics = topics_.size();
+  vector<int> topic_map(topics);
+  for (int i = 0; i < topics; i++) {
+    topic_map[i] = i;
+  }
+  size_t padded_topics = max(
+      padded_topics_,
+      (topics + TOPIC_PADDING - 1) / TOPIC_PADDING * TOPIC_PADDING);
+  reshape(layout, padded_topics, topic_map, topics);
+  pointTopics();
+}
+
+void AllTopics::reshape(TopicLayout layout,
+                        size_t padded_topics,
+                        const vector<int>& topic_map,
+                        int topics) {
+  vector<int> word_counts;
+  if (layout == TOPIC_LAYOUT_TOPIC) {
+    word_counts.assign(word_no_ * topics, 0);
+  } else if (layout == TOPIC_LAYOUT_WORD) {
+    word_counts.assign(word_no_ * padded_topics, 0);
+  }
+  vector<TokenIndex> topic_word_nos(topics, 0);
+  vector<vector<int>> word_topics(word_no_);
+  vector<int> dense_rows;
+  vector<vector<int>> word_topic_counts;
+  if (layout == TOPIC_LAYOUT_HYBRID) {
+    dense_rows.assign(word_no_, -1);
+    word_topic_counts.resize(word_no_);
+  }
+
+  for (size_t i = 0; i < topic_map.size(); i++) {
+    if (topic_map[i] != -1) {
+      topic_word_nos[topic_map[i]] = topics_[i].getTopicWordNo();
+    }
+  }
+
+  // The nonzero counts of each word, from the nonzero topic lists in
+  // the hybrid layout, which are always up to date.
+  vector<int> word_topic_ids;
+  vector<int> counts;
+  for (size_t w = 0; w < word_no_; w++) {
+    word_topic_ids.clear();
+    counts.clear();
+    if (layout_ == TOPIC_LAYOUT_HYBRID) {
+      int word_topic_no = word_topics_[w].size();
+      for (int i = 0; i < word_topic_no; i++) {
+        int k = topic_map[word_topics_[w][i]];
+        if (k != -1) {
+          word_topic_ids.push_back(k);
+          counts.push_back(getWordTopicCount(w, i));
+        }
+      }
+    } else {
+      for (size_t i = 0; i < topic_map.size(); i++) {
+        int count = topics_[i].getWordCount(w);
+        if (topic_map[i] != -1 && count != 0) {
+          word_topic_ids.push_back(topic_map[i]);
+          counts.push_back(count);
+        }
+      }
+    }
+
+    int word_topic_no = word_topic_ids.size();
+    if (layout == TOPIC_LAYOUT_HYBRID) {
+      if (word_topic_no * HYBRID_PROMOTE > padded_topics) {
+        dense_rows[w] = word_counts.size() / padded_topics;
+        word_counts.resize(word_counts.size() + padded_topics, 0);
+        for (int i = 0; i < word_topic_no; i++) {
+          word_counts[dense_rows[w] * padded_topics + word_topic_ids[i]] =
+              counts[i];
+        }
+      } else {
+        sortWordTopics(&word_topic_ids, &counts);
+        word_topic_counts[w] = counts;
+      }
+    } else {
+      for (int i = 0; i < word_topic_no; i++) {
+        int k = word_topic_ids[i];
+        size_t index = (layout == TOPIC_LAYOUT_WORD) ?
+                       w * padded_topics + k : k * word_no_ + w;
+        word_counts[index] = counts[i];
+      }
+    }
+    word_topics[w] = word_topic_ids;
+  }
+
+  layout_ = layout;
+  padded_topics_ = padded_topics;
+  word_counts_ = move(word_counts);
+  topic_word_nos_ = move(topic_word_nos);
+  word_topics_ = move(word_topics);
+  dense_rows_ = move(dense_rows);
+  free_rows_.clear();
+  word_topic_counts_ = move(word_topic_counts);
+}
+
+void AllTopics::pointTopics() {
+  int topics = topics_.size();
+  for (int i = 0; i < topics; i++) {
+    Topic* topic = &topics_[i];
+    topic->topic_word_no_ = &topic_word_nos_[i];
+    topic->all_topics_ = this;
+    topic->topic_id_ = i;
+    if (layout_ == TOPIC_LAYOUT_WORD) {
+      topic->word_counts_ = word_counts_.data() + i;
+      topic->stride_ = padded_topics_;
+    } else if (layout_ == TOPIC_LAYOUT_TOPIC) {
+      topic->word_counts_ = word_counts_.data() + i * word_no_;
+      topic->stride_ = 1;
+    } else {
+      topic->word_counts_ = nullptr;
+    }
+  }
+}
+
+void AllTopics::addWordCounts(int word_id, double* values) const {
+  size_t stride;
+  const int* row = getWordRow(word_id, &stride);
+  if (row != nullptr) {
+    int topics = topics_.size();
+    for (int i = 0; i < topics; i++) {
+      values[i] += row[i * stride];
+    }
+    return;
+  }
+
+  const vector<int>& word_topics = word_topics_[word_id];
+  const vector<int>& counts = word_topic_counts_[word_id];
+  int word_topic_no = word_topics.size();
+  for (int i = 0; i < word_topic_no; i++) {
+    values[word_topics[i]] += counts[i];
+  }
+}
+
+int AllTopics::getWordTopicCount(int word_id, int i) const {
+  size_t stride;
+  const int* row = getWordRow(word_id, &stride);
+  if (row != nullptr) {
+    return row[word_topics_[word_id][i] * stride];
+  }
+  return word_topic_counts_[word_id][i];
+}
+
+int AllTopics::getHybridWordCount(int topic_id, int word_id) const {
+  int row = dense_rows_[word_id];
+  if (row != -1) {
+    return word_counts_[row * padded_topics_ + topic_id];
+  }
+  const vector<int>& word_topics = word_topics_[word_id];
+  auto found = lower_bound(begin(word_topics), end(word_topics), topic_id);
+  if (found == end(word_topics) || *found != topic_id) {
+    return 0;
+  }
+  return word_topic_counts_[word_id][found - begin(word_topics)];
+}
+
+void AllTopics::setHybridWordCount(int topic_id, int word_id, int count) {
+  int old_count = getHybridWordCount(topic_id, word_id);
+  int row = dense_rows_[word_id];
+  if (row != -1) {
+    word_counts_[row * padded_topics_ + topic_id] = count;
+  }
+  updateWordTopics(topic_id, word_id, old_count, count);
+}
+
+void AllTopics::updateWordCount(int topic_id, int word_id, int update) {
+  if (layout_ == TOPIC_LAYOUT_HYBRID) {
+    topic_word_nos_[topic_id] += update;
+    int old_count = getHybridWordCount(topic_id, word_id);
+    int row = dense_rows_[word_id];
+    if (row != -1) {
+      word_counts_[row * padded_topics_ + topic_id] += update;
+    }
+    updateWordTopics(topic_id, word_id, old_count, old_count + update);
+    return;
+  }
+
+  Topic* topic = &topics_[topic_id];
+  int old_count = topic->getWordCount(word_id);
+  topic->setWordCount(word_id, old_count + update);
+  topic->setTopicWordNo(topic->getTopicWordNo() + update);
+  updateWordTopics(topic_id, word_id, old_count, old_count + update);
+}
+
+void AllTopics::updateWordTopics(int topic_id, int word_id,
+                                 int old_count, int new_count) {
+  vector<int>& word_topics = word_topics_[word_id];
+  bool sparse = (layout_ == TOPIC_LAYOUT_HYBRID &&
+                 dense_rows_[word_id] == -1);
+  if (sparse) {
+    // Sorted by topic, so that getHybridWordCount finds a count by
+    // binary search. The lists are short, at most 1/8 of the topics.
+    vector<int>& counts = word_topic_counts_[word_id];
+    auto found = lower_bound(begin(word_topics), end(word_topics), topic_id);
+    auto count = begin(counts) + (found - begin(word_topics));
+    if (old_count == 0 && new_count != 0) {
+      word_topics.insert(found, topic_id);
+      counts.insert(count, new_count);
+    } else if (old_count != 0 && new_count == 0) {
+      word_topics.erase(found);
+      counts.erase(count);
+    } else if (old_count != 0) {
+      *count = new_count;
+    }
+  } else if (old_count == 0 && new_count != 0) {
+    word_topics.push_back(topic_id);
+  } else if (old_count != 0 && new_count == 0) {
+    auto found = find(begin(word_topics), end(word_topics), topic_id);
+    *found = word_topics.back();
+    word_topics.pop_back();
+  }
+
+  if (layout_ == TOPIC_LAYOUT_HYBRID) {
+    size_t word_topic_no = word_topics.size();
+    if (sparse && word_topic_no * HYBRID_PROMOTE > padded_topics_) {
+      promoteWord(word_id);
+    } else if (!sparse && word_topic_no * HYBRID_DEMOTE < padded_topics_) {
+      demoteWord(word_id);
+    }
+  }
+}
+
+void AllTopics::promoteWord(int word_id) {
+  int row;
+  if (free_rows_.empty()) {
+    row = word_counts_.size() / padded_topics_;
+    word_counts_.resize(word_counts_.size() + padded_topics_, 0);
+  } else {
+    row = free_rows_.back();
+    free_rows_.pop_back();
   }
+  dense_rows_[word_id] = row;
 
-  score -= gsl_sf_lngamma(topic->getTopicWordNo() + word_count_size * eta);
+  const vector<int>& word_topics = word_topics_[word_id];
+  vector<int>& counts = word_topic_counts_[word_id];
+  int word_topic_no = word_topics.size();
+  for (int i = 0; i < word_topic_no; i++) {
+    word_counts_[row * padded_topics_ + word_topics[i]] = counts[i];
+  }
+  vector<int>().swap(counts);
+}
 
+void AllTopics::demoteWord(int word_id) {
+  int row = dense_rows_[word_id];
+  vector<int>& word_topics = word_topics_[word_id];
+  vector<int>& counts = word_topic_counts_[word_id];
+  sort(begin(word_topics), end(word_topics));
+  int word_topic_no = word_topics.size();
+  counts.resize(word_topic_no);
+  for (int i = 0; i < word_topic_no; i++) {
+    int& count = word_counts_[row * padded_topics_ + word_topics[i]];
+    counts[i] = count;
+    count = 0;
+  }
+  dense_rows_[word_id] = -1;
+  free_rows_.push_back(row);
+}
 
-  return score;
+void AllTopics::sortWordTopics(vector<int>* word_topics,
+                               vector<int>* counts) {
+  int word_topic_no = word_topics->size();
+  vector<pair<int, int>> pairs(word_topic_no);
+  for (int i = 0; i < word_topic_no; i++) {
+    pairs[i] = make_pair((*word_topics)[i], (*counts)[i]);
+  }
+  sort(begin(pairs), end(pairs));
+  for (int i = 0; i < word_topic_no; i++) {
+    (*word_topics)[i] = pairs[i].first;
+    (*counts)[i] = pairs[i].second;
+  }
 }
 
+void AllTopics::indexWordTopics() {
+  // The hybrid layout keeps the lists up to date as the counts are set.
+  if (layout_ == TOPIC_LAYOUT_HYBRID) return;
 
+  for (auto& word_topics : word_topics_) {
+    word_topics.clear();
+  }
+  int topics = topics_.size();
+  for (int i = 0; i < topics; i++) {
+    Topic* topic = &topics_[i];
+    for (size_t w = 0; w < word_no_; w++) {
+      if (topic->getWordCount(w) != 0) {
+        word_topics_[w].push_back(i);
+      }
+    }
+  }
+}
+
+void AllTopics::compactTopics(const vector<int>& topic_map) {
+  int topics = topics_.size();
+  assert(static_cast<int>(topic_map.size()) == topics);
+
+  int kept_topic_no = 0;
+  for (int i = 0; i < topics; i++) {
+    if (topic_map[i] != -1) {
+      assert(topic_map[i] == kept_topic_no);
+      kept_topic_no++;
+    }
+  }
+  size_t padded_topics =
+      (kept_topic_no + TOPIC_PADDING - 1) / TOPIC_PADDING * TOPIC_PADDING;
+  reshape(layout_, padded_topics, topic_map, kept_topic_no);
+
+  vector<Topic> kept_topics;
+  for (int i = 0; i < topics; i++) {
+    if (topic_map[i] != -1) {
+      kept_topics.push_back(move(topics_[i]));
+    }
+  }
+  topics_ = move(kept_topics);
+  pointTopics();
+}
+
+int AllTopics::getDenseWords() const {
+  if (layout_ == TOPIC_LAYOUT_TOPIC) return 0;
+  return word_counts_.size() / padded_topics_ - free_rows_.size();
+}
+
+size_t AllTopics::getBytes() const {
+  size_t bytes = (word_counts_.size() + dense_rows_.size()) * sizeof(int) +
+                 topic_word_nos_.size() * sizeof(TokenIndex);
+  for (size_t w = 0; w < word_no_; w++) {
+    bytes += word_topics_[w].capacity() * sizeof(int);
+  }
+  for (auto& counts : word_topic_counts_) {
+    bytes += counts.capacity() * sizeof(int);
+  }
+  return bytes;
+}
 
 // =======================================================================
 // AllTopicsUtils 
@@ -80,10 +465,27 @@ double TopicUtils::EtaScore(Topic* topic) {
 
 double AllTopicsUtils::EtaScores(AllTopics* all_topics) {
 	int topics = all_topics->getTopics();
+	if (topics == 0) return 0.0;
+
+	Topic* topic = all_topics->getMutableTopic(0);
+	int word_no = topic->getCorpusWordNo();
+	double eta = topic->getEta();
+	double lgam_eta = gsl_sf_lngamma(eta);
+
 	double score = 0.0;
 	for (int i = 0; i < topics; i++) {
-		Topic* topic = all_topics->getMutableTopic(i);
-		score += TopicUtils::EtaScore(topic);
+		score += gsl_sf_lngamma(word_no * eta) -
+				gsl_sf_lngamma(all_topics->getMutableTopic(i)->getTopicWordNo() +
+											 word_no * eta);
+	}
+
+	// Only the nonzero counts, through the per-word topic lists.
+	for (int w = 0; w < word_no; w++) {
+		int word_topic_no = all_topics->getWordTopics(w).size();
+		for (int i = 0; i < word_topic_no; i++) {
+			score += gsl_sf_lngamma(all_topics->getWordTopicCount(w, i) + eta) -
+					lgam_eta;
+		}
 	}
 	return score;
 }
@@ -91,14 +493,45 @@ double AllTopicsUtils::EtaScores(AllTopics* all_topics) {
 
 void AllTopicsUtils::SaveTopics(AllTopics* all_topics,
 																const string& filename,
-                                const string& filename_count) {
+                                const string& filename_count,
+                                const vector<int>* word_map,
+                                int word_no) {
 	ofstream ofs(filename);
 	ofstream ofs_count(filename_count);
 
+	// The nonzero counts of each topic by saved word id, from the
+	// per-word topic lists.
 	int topics = all_topics->getTopics();
+	vector<vector<pair<int, int>>> word_counts(topics);
+	vector<int> word_ids;
+	if (topics > 0) {
+		int corpus_word_no = all_topics->getMutableTopic(0)->getCorpusWordNo();
+		if (word_map != nullptr) {
+			word_ids.assign(word_no, -1);
+		}
+		for (int w = 0; w < corpus_word_no; w++) {
+			int word_id = (word_map != nullptr) ? (*word_map)[w] : w;
+			if (word_map != nullptr) {
+				word_ids[word_id] = w;
+			}
+			const vector<int>& word_topics = all_topics->getWordTopics(w);
+			int word_topic_no = word_topics.size();
+			for (int i = 0; i < word_topic_no; i++) {
+				word_counts[word_topics[i]].emplace_back(
+						word_id, all_topics->getWordTopicCount(w, i));
+			}
+		}
+	}
+
 	for (int i = 0; i < topics; i++) {
 		Topic* topic = all_topics->getMutableTopic(i);
-		TopicUtils::SaveTopic(topic, ofs, ofs_count);
+		if (word_map != nullptr) {
+			sort(word_counts[i].begin(), word_counts[i].end());
+		}
+		TopicUtils::SaveTopic(topic, word_counts[i],
+		                      (word_map != nullptr) ? &word_ids : nullptr,
+		                      ofs, ofs_count);
+		vector<pair<int, int>>().swap(word_counts[i]);
 	}
 	ofs.close();
   ofs_count.close();
@@ -139,40 +572,58 @@ void AllTopicsUtils::LoadTopics(AllTopics* all_topics,
   cout << "term_no : " << term_no << endl;
   cout << "eta : " << eta << endl;
 
+  // A line has term_no counts, longer than BUF_SIZE for large
+  // vocabularies.
   ifs = ifstream(filename_topics);
-  int topic_word_no = 0;
+  TokenIndex topic_word_no = 0;
 
+  all_topics->reserveTopics(topic_no);
   for (int i = 0; i < topic_no; i++) {
     all_topics->addTopic(term_no, eta);
     Topic* topic = all_topics->getMutableTopic(i);
 
-    ifs.getline(buf, BUF_SIZE);
-    istringstream iss(buf);
+    string line;
+    getline(ifs, line);
+    istringstream iss(line);
 
+    // The counts start at zero, only the nonzero ones are set.
     for (int w = 0; w < term_no; w++) {
       string str;
       iss >> str;
-      topic_word_no += atoi(str.c_str());
-      topic->setWordCount(w, atoi(str.c_str()));
+      int word_count = atoi(str.c_str());
+      topic_word_no += word_count;
+      if (word_count != 0) {
+        topic->setWordCount(w, word_count);
+      }
     }
 
     topic->setTopicWordNo(topic_word_no);
   }
 
   ifs.close();
-  
+
+  all_topics->indexWordTopics();
 }
 
 vector<double> AllTopicsUtils::WordProbabilities(AllTopics* all_topics, int word_id) {
+  vector<double> log_pr(all_topics->getTopics(), 0.0);
+  WordProbabilities(all_topics, word_id, log_pr.data());
+  return log_pr;
+}
+
+void AllTopicsUtils::WordProbabilities(AllTopics* all_topics, int word_id,
+                                       double* log_pr) {
   int topic_no = all_topics->getTopics();
-  vector<double> log_pr(topic_no, 0.0);
+  fill(log_pr, log_pr + topic_no, 0.0);
 
+  Topic* topic = all_topics->getMutableTopic(0);
+  double eta = topic->getEta();
+  double eta_sum = eta * topic->getCorpusWordNo();
+  all_topics->addWordCounts(word_id, log_pr);
+  const TokenIndex* topic_word_nos = all_topics->getTopicWordNos();
   for (int i = 0; i < topic_no; i++) {
-    Topic* topic = all_topics->getMutableTopic(i);
-    log_pr[i] = topic->getLogPrWord(word_id);
+    log_pr[i] = log(eta + log_pr[i]) - log(eta_sum + topic_word_nos[i]);
   }
-
-  return log_pr;
 }
 
 
@@ -8,10 +8,14 @@
 #include <gsl/gsl_sf.h>
 #include <iostream>
 
+#include "token_index.h"
+
 using namespace std;
 
 namespace atm {
 
+class AllTopics;
+
 // The topic in the atm implementation.
 // Each topic contains word statistics,
 // the number of authors it is assigned to,
@@ -19,24 +23,26 @@ namespace atm {
 // pointers to the parent and children topics,
 // a pointer to the tree this topic belongs to,
 // and a probability for sampling the path.
+// The word counts and the total of the topic are stored by AllTopics,
+// see TopicLayout, and the topic points to them.
 class Topic {
 public:
 	Topic(int corpus_word_no, double eta);
 	
   double getLogPrWord(int word_id) const {
-  	return log(eta_ + word_counts_[word_id]) -
-  				 log(eta_ * corpus_word_no_ + topic_word_no_); }
+  	return log(eta_ + getWordCount(word_id)) -
+  				 log(eta_ * corpus_word_no_ + *topic_word_no_); }
 
-  int getWordCount(int word_id) const { return word_counts_[word_id]; }
-  void setWordCount(int word_id, int count) { word_counts_[word_id] = count; }
-	// Update the count of a word in a given topic.
-  void updateWordCount(int word_id, int update);
+  int getWordCount(int word_id) const;
+  void setWordCount(int word_id, int count);
 
-  void setTopicWordNo(int topic_word_no) { topic_word_no_ = topic_word_no; }
-  int getTopicWordNo() const { return topic_word_no_; }
+  void setTopicWordNo(TokenIndex topic_word_no) {
+    *topic_word_no_ = topic_word_no;
+  }
+  TokenIndex getTopicWordNo() const { return *topic_word_no_; }
 
   double getLgamWordCountEta(int word_id) const {
-    return gsl_sf_lngamma(word_counts_[word_id] + eta_);
+    return gsl_sf_lngamma(getWordCount(word_id) + eta_);
   }
 
   int getCorpusWordNo() const { return corpus_word_no_; }
@@ -45,30 +51,37 @@ public:
   void setEta(double eta) { eta_ = eta; }
 
 private:
+	friend class AllTopics;
+
 	// Total number of words assigned to this topic.
-	int topic_word_no_;
+	TokenIndex* topic_word_no_;
 
 	// Total number of words in the corpus.
 	int corpus_word_no_;
 
-	// Word counts.
-	vector<int> word_counts_;
+	// Word counts, the count of word w is word_counts_[w * stride_].
+	// Null in the hybrid layout, where the counts are looked up in
+	// all_topics_ by topic_id_.
+	int* word_counts_;
+	size_t stride_;
+	AllTopics* all_topics_;
+	int topic_id_;
 
 	// Eta
 	double eta_;
 
 };
 
-// This class provides functionality for calculating Eta.
+// This class provides functionality for saving a topic.
 class TopicUtils {
  public:
-  // Compute the Eta score which is a topic score.
-  // The Eta parameter represents the expected variance of the
-  // underlying topics.
-  static double EtaScore(Topic* topic);
-
- 
+  // Write the word probabilities and the word counts of the topic,
+  // word_counts are its nonzero (word id, count) sorted by word id.
+  // word_ids, if given, is the word id of each saved id, -1 for the ids
+  // that are not in the vocabulary, which get probability 0.
   static void SaveTopic(Topic* topic, 
+                        const vector<pair<int, int>>& word_counts,
+                        const vector<int>* word_ids,
   											ofstream& ofs,
   											ofstream& ofs_count);
 
@@ -76,26 +89,172 @@ class TopicUtils {
 
 
 
+// Layout of the topic word counts.
+// TOPIC_LAYOUT_TOPIC stores the counts of each topic together (K x V),
+// so the counts of one word in all the topics are V apart.
+// TOPIC_LAYOUT_WORD stores the counts of each word together (V x K,
+// K padded to 16 ints), so they sit in one or two cache lines, which
+// suits the samplers that compute all the topics of a word.
+// TOPIC_LAYOUT_HYBRID keeps such a dense row only for the words in
+// many topics, and the counts of the other words next to their nonzero
+// topics (see AllTopics::getWordTopics), so that memory follows the
+// nonzero counts instead of K x V. A word moves to a dense row once it
+// is in more than 1/8 of the topics, and back below 1/16.
+enum TopicLayout {
+  TOPIC_LAYOUT_TOPIC,
+  TOPIC_LAYOUT_WORD,
+  TOPIC_LAYOUT_HYBRID,
+};
+
 // AllTopics store all the topics globally.
 // This class provides functionality of 
 // adding new topic.
+// The word counts of all the topics are in one array, in the layout
+// given by setLayout, and the totals of the topics in another.
 class AllTopics {
 public:
+	AllTopics();
+
 	vector<Topic>& getMutableTopics() { return topics_; }
 	int getTopics() const { return topics_.size(); }
-	void addTopic(int corpus_word_no, double eta) {
-		topics_.emplace_back(Topic(corpus_word_no, eta));
-	}
+	void addTopic(int corpus_word_no, double eta);
 	Topic* getMutableTopic(int i) {
 		return &topics_[i];
 	}
 
+	// Room for this many topics in the rows of the word-major and hybrid
+	// layouts, so that adding them does not move the rows.
+	void reserveTopics(int topics);
+
+	// Move the word counts to the layout.
+	void setLayout(TopicLayout layout);
+	TopicLayout getLayout() const { return layout_; }
+
+	// Add the count of the word in topic k to values[k], for all topics.
+	void addWordCounts(int word_id, double* values) const;
+
+	// The count of the word in its i-th nonzero topic, getWordTopics(word_id)[i].
+	int getWordTopicCount(int word_id, int i) const;
+
+	// The totals of the topics.
+	const TokenIndex* getTopicWordNos() const { return topic_word_nos_.data(); }
+
+	// Update the count of a word in the given topic and keep
+	// the per-word nonzero topic lists up to date.
+	void updateWordCount(int topic_id, int word_id, int update);
+
+	// Topics in which the word has a nonzero count, in increasing order
+	// for a word without a dense row in the hybrid layout, in no
+	// particular order otherwise.
+	const vector<int>& getWordTopics(int word_id) const {
+		return word_topics_[word_id];
+	}
+
+	// Rebuild the per-word nonzero topic lists from the word counts,
+	// needed after the counts are set directly (e.g. when loading).
+	void indexWordTopics();
+
+	// Remove the topics mapped to -1 and renumber the others,
+	// topic_map[k] is the new id of topic k.
+	void compactTopics(const vector<int>& topic_map);
+
+	// Words with a dense row, and memory of the word counts in bytes.
+	int getDenseWords() const;
+	size_t getBytes() const;
+
 private:
+	friend class Topic;
+
+	// Row of the counts of the word, nullptr for a word without a dense
+	// row in the hybrid layout. The count in topic k is row[k * stride].
+	const int* getWordRow(int word_id, size_t* stride) const {
+		if (layout_ == TOPIC_LAYOUT_TOPIC) {
+			*stride = word_no_;
+			return &word_counts_[word_id];
+		}
+		*stride = 1;
+		if (layout_ == TOPIC_LAYOUT_WORD) {
+			return &word_counts_[word_id * padded_topics_];
+		}
+		int row = dense_rows_[word_id];
+		return (row == -1) ? nullptr : &word_counts_[row * padded_topics_];
+	}
+
+	// Counts of the hybrid layout, see Topic.
+	int getHybridWordCount(int topic_id, int word_id) const;
+	void setHybridWordCount(int topic_id, int word_id, int count);
+
+	// Add or remove the topic from the nonzero topics of the word as its
+	// count goes from old_count to new_count, with the count itself for
+	// a word without a dense row in the hybrid layout.
+	void updateWordTopics(int topic_id, int word_id,
+												int old_count, int new_count);
+
+	// Sort the nonzero topics of a word without a dense row in the hybrid
+	// layout, with their counts.
+	static void sortWordTopics(vector<int>* word_topics, vector<int>* counts);
+
+	// Give the word a dense row, or move it back next to its nonzero
+	// topics, in the hybrid layout.
+	void promoteWord(int word_id);
+	void demoteWord(int word_id);
+
+	// Copy the counts of the topics to new arrays in the layout with
+	// room for padded_topics topics per row, topic k moving to
+	// topic_map[k] of topics, or dropped if -1. The nonzero topic lists
+	// are rebuilt.
+	void reshape(TopicLayout layout,
+							 size_t padded_topics,
+							 const vector<int>& topic_map,
+							 int topics);
+
+	// Point the topics to their counts and totals.
+	void pointTopics();
+
 	// All topics.
 	vector<Topic> topics_;
+
+	TopicLayout layout_;
+
+	// Number of words in the vocabulary.
+	size_t word_no_;
+
+	// Topics room per row in the word-major and hybrid layouts.
+	size_t padded_topics_;
+
+	// Word counts of all the topics, the dense rows in the hybrid layout.
+	vector<int> word_counts_;
+
+	// Total number of words assigned to each topic.
+	vector<TokenIndex> topic_word_nos_;
+
+	// For each word id, the topics with a nonzero count of that word.
+	vector<vector<int>> word_topics_;
+
+	// Hybrid layout: the dense row of each word or -1, the rows no
+	// longer used, and for the words without a row the count in each
+	// of their nonzero topics, which are sorted.
+	vector<int> dense_rows_;
+	vector<int> free_rows_;
+	vector<vector<int>> word_topic_counts_;
 	
 };
 
+inline int Topic::getWordCount(int word_id) const {
+	if (word_counts_ != nullptr) {
+		return word_counts_[word_id * stride_];
+	}
+	return all_topics_->getHybridWordCount(topic_id_, word_id);
+}
+
+inline void Topic::setWordCount(int word_id, int count) {
+	if (word_counts_ != nullptr) {
+		word_counts_[word_id * stride_] = count;
+	} else {
+		all_topics_->setHybridWordCount(topic_id_, word_id, count);
+	}
+}
+
 // This class provides functionality for computing
 // Eta scores.
 class AllTopicsUtils {
@@ -104,15 +263,22 @@ public:
 	// eta - dirichlet distribution parameter of each topic.
 	static double EtaScores(AllTopics* all_topics);
 
+	// Write the topics, over the word ids or, if word_map is given, over
+	// the word_no ids that it maps the word ids to.
 	static void SaveTopics(AllTopics* all_topics, 
 												 const string& filename,
-												 const string& filename_count);
+												 const string& filename_count,
+												 const vector<int>* word_map = nullptr,
+												 int word_no = 0);
 
 	static void LoadTopics(AllTopics* all_topics,
 												const string& filename_topics,
 												const string& filename_other);
 
 	static vector<double> WordProbabilities(AllTopics* all_topics, int word_id);
+	// The same in log_pr, which holds the topic number.
+	static void WordProbabilities(AllTopics* all_topics, int word_id,
+																double* log_pr);
 
 };
 
@@ -0,0 +1,65 @@
+#include "topic_pruner.h"
+
+namespace atm {
+
+// =======================================================================
+// TopicPruner
+// =======================================================================
+
+TopicPruner::TopicPruner()
+    : window_(50),
+      max_words_(0),
+      topics_(0) {
+}
+
+bool TopicPruner::update(AllTopics* all_topics) {
+  int topics = all_topics->getTopics();
+  small_iterations_.resize(topics, 0);
+
+  int dead = 0;
+  for (int i = 0; i < topics; i++) {
+    if (all_topics->getMutableTopic(i)->getTopicWordNo() <= max_words_) {
+      small_iterations_[i]++;
+    } else {
+      small_iterations_[i] = 0;
+    }
+    if (small_iterations_[i] >= window_) {
+      dead++;
+    }
+  }
+  if (dead == 0) return false;
+
+  // Keep the largest topic if all of them are dead.
+  int largest = -1;
+  if (dead == topics) {
+    largest = 0;
+    for (int i = 1; i < topics; i++) {
+      if (all_topics->getMutableTopic(i)->getTopicWordNo() >
+          all_topics->getMutableTopic(largest)->getTopicWordNo()) {
+        largest = i;
+      }
+    }
+  }
+
+  topic_map_.assign(topics, -1);
+  topics_ = 0;
+  for (int i = 0; i < topics; i++) {
+    if (small_iterations_[i] < window_ || i == largest) {
+      topic_map_[i] = topics_++;
+    }
+  }
+  return topics_ < topics;
+}
+
+void TopicPruner::compact() {
+  int topics = topic_map_.size();
+  vector<int> small_iterations(topics_, 0);
+  for (int i = 0; i < topics; i++) {
+    if (topic_map_[i] != -1) {
+      small_iterations[topic_map_[i]] = small_iterations_[i];
+    }
+  }
+  small_iterations_ = move(small_iterations);
+}
+
+}  // namespace atm
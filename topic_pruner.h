@@ -0,0 +1,50 @@
+#ifndef TOPIC_PRUNER_H_
+#define TOPIC_PRUNER_H_
+
+#include <vector>
+
+#include "topic.h"
+
+using namespace std;
+
+namespace atm {
+
+// Detection of dead topics during training.
+// A topic is dead once it has had at most max_words words for window
+// consecutive iterations. The dead topics are mapped to -1 and the
+// others renumbered in order, see GibbsSampler::PruneTopics, so that
+// the topic number and the cost of every later sweep shrink.
+// At least one topic is always kept.
+class TopicPruner {
+ public:
+  TopicPruner();
+
+  void setWindow(int window) { window_ = window; }
+  void setMaxWords(int max_words) { max_words_ = max_words; }
+
+  // Update the statistics of the topics after an iteration and return
+  // true if some topics are dead.
+  bool update(AllTopics* all_topics);
+
+  // The new id of each topic, -1 for the dead topics, set by update.
+  const vector<int>& getTopicMap() const { return topic_map_; }
+  // Number of topics left.
+  int getTopics() const { return topics_; }
+
+  // Renumber the statistics as the topics have been compacted.
+  void compact();
+
+ private:
+  int window_;
+  int max_words_;
+
+  // Consecutive iterations each topic has had at most max_words words.
+  vector<int> small_iterations_;
+
+  vector<int> topic_map_;
+  int topics_;
+};
+
+}  // namespace atm
+
+#endif  // TOPIC_PRUNER_H_
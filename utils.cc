@@ -16,20 +16,26 @@
 #include <assert.h>
 #include <math.h>
 #include <time.h>
+#include <string.h>
 #include <gsl/gsl_sf.h>
 
+#include <algorithm>
 #include <iostream>
 
+#include "sample_kernel.h"
 #include "utils.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#define ATM_UTILS_X86 1
+#include <immintrin.h>
+#endif
+
 namespace atm {
 
 // =======================================================================
 // Utils
 // =======================================================================
 
-gsl_rng* Utils::RANDNUMGEN = NULL;
-
 double Utils::Sum(const vector<double>& v) {
   double sum = 0;
   int size = v.size();
@@ -47,7 +53,7 @@ double Utils::LogSum(double log_a, double log_b) {
   }
 }
 
-int Utils::SampleFromLogPr(const vector<double>& log_pr) {
+int Utils::SampleFromLogPr(const vector<double>& log_pr, double rand_no) {
   assert(log_pr.size() > 0);
   // Initialize the log_sum to the log probability at level 0.
   double log_sum = log_pr[0];
@@ -58,9 +64,6 @@ int Utils::SampleFromLogPr(const vector<double>& log_pr) {
     log_sum = LogSum(log_sum, log_pr[i]);
   }
 
-  // Obtain a random number.
-  double rand_no = RandNo();
-
   double log_exp = exp(log_pr[0] - log_sum);
   int result = 0;
   while (rand_no >= log_exp) {
@@ -71,28 +74,194 @@ int Utils::SampleFromLogPr(const vector<double>& log_pr) {
   return result;
 }
 
-void Utils::InitRandomNumberGen(long rng_seed) {
-  if (RANDNUMGEN != NULL) return;
+// =======================================================================
+// Random
+// =======================================================================
+
+namespace {
+
+// The jump polynomials of xoshiro256 (Blackman and Vigna).
+const uint64_t JUMP[4] = {
+  0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+  0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+};
+const uint64_t LONG_JUMP[4] = {
+  0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+  0x77710069854ee241ULL, 0x39109bb02acbe635ULL
+};
+
+inline uint64_t RotateLeft(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+uint64_t SplitMix64(uint64_t* x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// One xoshiro256 step of the state s.
+inline void Step(uint64_t* s) {
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = RotateLeft(s[3], 45);
+}
 
-  RANDNUMGEN = gsl_rng_alloc(gsl_rng_taus);
-  cout << "Random seed = " << rng_seed << endl;
-  gsl_rng_set(RANDNUMGEN, rng_seed);
+// Advance the state s as far as the polynomial says.
+void Jump(uint64_t* s, const uint64_t* polynomial) {
+  uint64_t jumped[4] = {0, 0, 0, 0};
+  for (int w = 0; w < 4; w++) {
+    for (int b = 0; b < 64; b++) {
+      if (polynomial[w] & (1ULL << b)) {
+        for (int i = 0; i < 4; i++) {
+          jumped[i] ^= s[i];
+        }
+      }
+      Step(s);
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    s[i] = jumped[i];
+  }
 }
 
-void Utils::Shuffle(gsl_permutation* permutation, int size) {
-  assert(RANDNUMGEN != NULL);
-  gsl_ran_shuffle(RANDNUMGEN, permutation->data, size, sizeof(size_t));
+}  // namespace
+
+Random::Random() {
+  setState(0, 0);
 }
 
-double Utils::RandGauss(double mean, double stdev) {
-  assert(RANDNUMGEN != NULL);
-  double gauss = gsl_ran_gaussian_ratio_method(RANDNUMGEN, stdev) + mean;
-  return(gauss);
+void Random::seed(long rng_seed, int stream) {
+  cout << "Random seed = " << rng_seed << ", stream = " << stream << endl;
+  setState(rng_seed, stream);
 }
 
-double Utils::RandNo() {
-  assert(RANDNUMGEN != NULL);
-  return gsl_rng_uniform(RANDNUMGEN);
+void Random::setState(long rng_seed, int stream) {
+  assert(stream >= 0);
+  uint64_t x = static_cast<uint64_t>(rng_seed);
+  uint64_t s[4];
+  for (int i = 0; i < 4; i++) {
+    s[i] = SplitMix64(&x);
+  }
+  for (int i = 0; i < stream; i++) {
+    Jump(s, LONG_JUMP);
+  }
+  for (int j = 0; j < LANES; j++) {
+    for (int i = 0; i < 4; i++) {
+      state_[i][j] = s[i];
+    }
+    Jump(s, JUMP);
+  }
+  next_ = BATCH;
+}
+
+void Random::fillBatch(double* values) {
+#ifdef ATM_UTILS_X86
+  if (SampleKernel::GetIsa() != KERNEL_SCALAR) {
+    fillBatchAvx2(values);
+    return;
+  }
+#endif
+  fillBatchScalar(values);
+}
+
+void Random::fillBatchScalar(double* values) {
+  for (int k = 0; k < BATCH; k += LANES) {
+    for (int j = 0; j < LANES; j++) {
+      uint64_t result = state_[0][j] + state_[3][j];
+      uint64_t t = state_[1][j] << 17;
+      state_[2][j] ^= state_[0][j];
+      state_[3][j] ^= state_[1][j];
+      state_[1][j] ^= state_[2][j];
+      state_[0][j] ^= state_[3][j];
+      state_[2][j] ^= t;
+      state_[3][j] = RotateLeft(state_[3][j], 45);
+      // The top 52 bits as the mantissa of a double in [1, 2).
+      uint64_t bits = (result >> 12) | 0x3ff0000000000000ULL;
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+      values[k + j] = value - 1.0;
+    }
+  }
+}
+
+#ifdef ATM_UTILS_X86
+// The four lanes in the four 64-bit elements of a register.
+__attribute__((target("avx2")))
+void Random::fillBatchAvx2(double* values) {
+  __m256i s0 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state_[0]));
+  __m256i s1 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state_[1]));
+  __m256i s2 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state_[2]));
+  __m256i s3 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(state_[3]));
+  const __m256i exponent = _mm256_set1_epi64x(0x3ff0000000000000LL);
+  const __m256d one = _mm256_set1_pd(1.0);
+  for (int k = 0; k < BATCH; k += LANES) {
+    __m256i result = _mm256_add_epi64(s0, s3);
+    __m256i t = _mm256_slli_epi64(s1, 17);
+    s2 = _mm256_xor_si256(s2, s0);
+    s3 = _mm256_xor_si256(s3, s1);
+    s1 = _mm256_xor_si256(s1, s2);
+    s0 = _mm256_xor_si256(s0, s3);
+    s2 = _mm256_xor_si256(s2, t);
+    s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+    __m256i bits = _mm256_or_si256(_mm256_srli_epi64(result, 12), exponent);
+    _mm256_storeu_pd(values + k, _mm256_sub_pd(_mm256_castsi256_pd(bits), one));
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(state_[0]), s0);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(state_[1]), s1);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(state_[2]), s2);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(state_[3]), s3);
+}
+#endif  // ATM_UTILS_X86
+
+void Random::fillUniform(double* values, long size) {
+  long done = 0;
+  while (done < size) {
+    if (next_ == BATCH && size - done >= BATCH) {
+      fillBatch(values + done);
+      done += BATCH;
+      continue;
+    }
+    if (next_ == BATCH) {
+      fillBatch(buffer_);
+      next_ = 0;
+    }
+    int count = static_cast<int>(min<long>(size - done, BATCH - next_));
+    memcpy(values + done, buffer_ + next_, count * sizeof(double));
+    next_ += count;
+    done += count;
+  }
+}
+
+double Random::gauss(double mean, double stdev) {
+  // Marsaglia's polar method, the second variate is dropped.
+  double u;
+  double v;
+  double r;
+  do {
+    u = 2.0 * uniform() - 1.0;
+    v = 2.0 * uniform() - 1.0;
+    r = u * u + v * v;
+  } while (r >= 1.0 || r == 0.0);
+  return mean + stdev * u * sqrt(-2.0 * log(r) / r);
+}
+
+void Random::shuffle(gsl_permutation* permutation, int size) {
+  size_t* data = permutation->data;
+  for (int i = size - 1; i > 0; i--) {
+    swap(data[i], data[uniformInt(i + 1)]);
+  }
+}
+
+void Random::shuffle(TokenIndex* values, int size) {
+  for (int i = size - 1; i > 0; i--) {
+    swap(values[i], values[uniformInt(i + 1)]);
+  }
 }
 
 }  // namespace atm
@@ -17,18 +17,18 @@
 #define UTILS_H_
 
 #include <gsl/gsl_permutation.h>
-#include <gsl/gsl_randist.h>
+#include <stdint.h>
 
 #include <vector>
 
+#include "token_index.h"
+
 using namespace std;
 
 namespace atm {
 
-// This class provides functionality for summing values,
-// for reading data from files and also provides
-// an interface to gsl specific methods.
-// This class is not thread-safe (see private static gsl_rng* RANDNUMGEN).
+// This class provides functionality for summing values
+// and for sampling from log probabilities.
 class Utils {
  public:
   // Sum up the values in a vector.
@@ -45,25 +45,78 @@ class Utils {
   // The log_pr vector keeps for each level
   // the current log probability of the word + the current
   // log probability of the level in the tree.
-  // These values are used to sample the new level.
+  // These values are used to sample the new level with rand_no,
+  // uniform in [0, 1).
   // The vector should contain at least one element.
-  static int SampleFromLogPr(const vector<double>& log_pr);
+  static int SampleFromLogPr(const vector<double>& log_pr, double rand_no);
+};
 
-  // Shuffle the values in a gsl_permutation.
-  static void Shuffle(gsl_permutation* permutation, int size);
+// A xoshiro256+ random number generator (Blackman and Vigna), run as
+// LANES independent lanes so that a batch of uniforms is computed with
+// SIMD. The lanes are 2^128 draws apart and the streams 2^192 draws
+// apart, all derived from the seed with splitmix64, so the streams of a
+// seed never overlap: a thread or a repetition that draws from its own
+// stream gets the same numbers whatever the others do.
+// The numbers come out of a buffer of BATCH uniforms, lane after lane
+// for each step, and uniform() and fillUniform() read the same sequence.
+// Only the top 52 bits of an output are used, the weak low bits of
+// xoshiro256+ never reach a uniform.
+// Each ModelContext owns one. This class is not thread-safe.
+class Random {
+ public:
+  static const int LANES = 4;
+  static const int BATCH = 256;
+
+  // Seeded with 0, stream 0.
+  Random();
+
+  Random(const Random& from) = delete;
+  Random& operator=(const Random& from) = delete;
+
+  // Seed the generator, rng_seed is the random number generator seed and
+  // stream the index of the independent stream of that seed to draw from.
+  void seed(long rng_seed, int stream = 0);
 
-  // Initialize the random number generator.
-  // rng_seed is the random number generator seed.
-  static void InitRandomNumberGen(long rng_seed);
+  // Return a random number uniform in [0, 1), with 52 random bits.
+  double uniform() {
+    if (next_ == BATCH) {
+      fillBatch(buffer_);
+      next_ = 0;
+    }
+    return buffer_[next_++];
+  }
 
-  // Return a gsl Gaussian random variate with mean and stdev as parameters
-  static double RandGauss(double mean, double stdev);
+  // Return a random integer uniform in [0, n).
+  int uniformInt(int n) { return static_cast<int>(uniform() * n); }
 
-  // Return a random number using the gsl random number generator.
-  static double RandNo();
+  // Fill values with size uniforms in [0, 1), the same numbers as size
+  // calls to uniform(). Whole batches are written in place.
+  void fillUniform(double* values, long size);
+
+  // Return a Gaussian random variate with mean and stdev as parameters.
+  double gauss(double mean, double stdev);
+
+  // Shuffle the values in a gsl_permutation.
+  void shuffle(gsl_permutation* permutation, int size);
+
+  // Shuffle size word indices in place, with the same swaps as
+  // shuffling a permutation of them, and without allocating.
+  void shuffle(TokenIndex* values, int size);
 
  private:
-  static gsl_rng* RANDNUMGEN;
+  void setState(long rng_seed, int stream);
+
+  // Compute the next BATCH uniforms into values, with AVX2 when the
+  // sampling kernel uses it. Both give the same numbers.
+  void fillBatch(double* values);
+  void fillBatchScalar(double* values);
+  void fillBatchAvx2(double* values);
+
+  // The state words of the lanes, state_[i][lane].
+  uint64_t state_[4][LANES];
+
+  double buffer_[BATCH];
+  int next_;
 };
 
 }  // namespace atm